@@ -0,0 +1,133 @@
+#ifndef COLUMN_PLAN_H
+#define COLUMN_PLAN_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../external/json.hpp"
+#include "../include/memgraph_client.hpp"
+
+struct ColumnSpec;
+
+/// <summary>
+/// Decodes one non-null column value of a row image into the mg::Value that
+/// is stored in Memgraph.
+/// </summary>
+using ColumnDecoder = mg::Value (*)(const nlohmann::json &value,
+                                    const ColumnSpec &column);
+
+/// <summary>
+/// How one column of a table is decoded, chosen once from its Debezium
+/// schema.
+/// </summary>
+struct ColumnSpec {
+  std::string name;
+  ColumnDecoder decode = nullptr;
+
+  /// <summary>
+  /// Number of fractional digits of a Decimal column.
+  /// </summary>
+  int scale = 0;
+};
+
+/// <summary>
+/// Decodes the columns of one table's row images. The plan is derived once
+/// from the row schema that Debezium sends in the envelope's 'schema' block
+/// (JSON converter with 'schemas.enable'), so every column goes straight to
+/// its Memgraph type without inspecting each value:
+///
+///   int8..int64           -> Int (64-bit)
+///   float32, float64      -> Double
+///   Decimal (bytes)       -> Double up to 15 digits of precision, else an
+///                            exact decimal String
+///   io.debezium.time.Date -> Date
+///   (Micro|Nano)Timestamp -> LocalDateTime
+///   (Micro|Nano)Time      -> LocalTime
+///   array, map, struct    -> List or Map
+///   anything else         -> as sent (String, Bool, ...)
+///
+/// Nulls decode to null for every column. Columns the schema does not know
+/// are decoded by their JSON type, as are all columns without a schema.
+/// </summary>
+class ColumnPlan {
+public:
+  /// <summary>
+  /// Builds the plan for a Debezium row struct schema, i.e. the entry of the
+  /// envelope schema's 'fields' whose 'field' is "after" or "before".
+  /// </summary>
+  explicit ColumnPlan(const nlohmann::json &row_schema);
+
+  /// <summary>
+  /// Decodes the value of column 'name'.
+  /// </summary>
+  mg::Value Decode(const std::string &name, const nlohmann::json &value) const;
+
+  /// <summary>
+  /// Decodes the value of column 'name', which is expected at 'index' of
+  /// Columns(). A row image iterates its columns by name, as they are
+  /// sorted here, so the i-th column of a row is decoded without a lookup;
+  /// any other column is looked up by name.
+  /// </summary>
+  mg::Value Decode(size_t index, const std::string &name,
+                   const nlohmann::json &value) const;
+
+  /// <summary>
+  /// Returns the planned columns, sorted by name.
+  /// </summary>
+  const std::vector<ColumnSpec> &Columns() const;
+
+  /// <summary>
+  /// Decodes a value by its JSON type, for columns without a schema.
+  /// </summary>
+  static mg::Value DecodeJson(const nlohmann::json &value);
+
+private:
+  std::vector<ColumnSpec> columns;
+};
+
+/// <summary>
+/// Column plans per table, rebuilt whenever a table's row schema changes.
+/// </summary>
+class ColumnPlanCache {
+public:
+  /// <summary>
+  /// Returns the plan for the row schema in a Debezium envelope schema.
+  /// </summary>
+  /// <param name="table">The source table of the event.</param>
+  /// <param name="envelope_schema">The envelope's 'schema' block.</param>
+  /// <returns>The plan, or null if the schema describes no row
+  /// struct.</returns>
+  const ColumnPlan *Get(const std::string &table,
+                        const nlohmann::json &envelope_schema);
+
+private:
+  struct Entry {
+    nlohmann::json schema;
+    std::unique_ptr<ColumnPlan> plan;
+  };
+
+  std::unordered_map<std::string, Entry> plans;
+};
+
+/// <summary>
+/// Formats days since the epoch as 'YYYY-MM-DD', which Cypher's date()
+/// accepts.
+/// </summary>
+std::string format_date(int64_t days);
+
+/// <summary>
+/// Formats nanoseconds since midnight as 'hh:mm:ss[.ffffff]', which Cypher's
+/// localTime() accepts. Memgraph keeps microseconds.
+/// </summary>
+std::string format_local_time(int64_t nanoseconds);
+
+/// <summary>
+/// Formats a local date-time as 'YYYY-MM-DDThh:mm:ss[.ffffff]', which
+/// Cypher's localDateTime() accepts.
+/// </summary>
+std::string format_local_date_time(int64_t seconds, int64_t nanoseconds);
+
+#endif // COLUMN_PLAN_H
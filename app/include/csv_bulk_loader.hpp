@@ -0,0 +1,167 @@
+#ifndef CSV_BULK_LOADER_H
+#define CSV_BULK_LOADER_H
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../include/memgraph_client.hpp"
+
+/// <summary>
+/// Configuration of a CsvBulkLoader.
+/// </summary>
+struct CsvBulkLoaderOptions {
+  /// <summary>
+  /// Directory the CSV files are written to.
+  /// </summary>
+  std::string directory;
+
+  /// <summary>
+  /// The same directory as Memgraph sees it, used in the LOAD CSV queries.
+  /// Empty means Memgraph sees it at 'directory', e.g. on a shared volume
+  /// mounted at the same path in both containers.
+  /// </summary>
+  std::string load_directory;
+
+  /// <summary>
+  /// A file is loaded as soon as it holds this many rows. 0 loads files only
+  /// on Flush().
+  /// </summary>
+  size_t rotate_rows = 100000;
+
+  /// <summary>
+  /// Whether to log every loaded file.
+  /// </summary>
+  bool log_events = true;
+};
+
+/// <summary>
+/// Stages nodes and relationships as CSV files, one open file per label and
+/// per relationship shape, and loads each finished file with a single
+/// 'LOAD CSV' query instead of one Bolt query per row. Meant for append-only
+/// snapshot loads, where it is much faster than parameterized writes.
+///
+/// Rows are given as the same parameter maps the mapping functions pass to
+/// MemgraphClient::ExecuteQuery(): 'id' (nodes) or 'from_id' and 'to_id'
+/// (relationships), optionally 'src_pos', and the properties in 'props'.
+/// Column types are recorded per file and restored in the LOAD CSV query. A
+/// row that adds a column or changes a column's type starts a new file. Node
+/// files are always loaded before relationship files so that edges find their
+/// endpoints.
+/// </summary>
+class CsvBulkLoader {
+public:
+  /// <summary>
+  /// Constructs a CsvBulkLoader writing to 'options.directory'.
+  /// </summary>
+  /// <exception cref="std::runtime_error">Thrown if the directory is not
+  /// set.</exception>
+  explicit CsvBulkLoader(const CsvBulkLoaderOptions &options);
+
+  /// <summary>
+  /// Closes and removes any files that were never loaded.
+  /// </summary>
+  ~CsvBulkLoader();
+
+  // Disallow copy and assignment to prevent issues with resource ownership.
+  CsvBulkLoader(const CsvBulkLoader &) = delete;
+  CsvBulkLoader &operator=(const CsvBulkLoader &) = delete;
+
+  /// <summary>
+  /// Stages a node to be CREATEd.
+  /// </summary>
+  /// <returns>False if a value has a type CSV cannot carry, in which case the
+  /// caller must write the node itself.</returns>
+  /// <exception cref="std::runtime_error">Thrown if a file cannot be written
+  /// or a rotation's LOAD CSV fails.</exception>
+  bool AddNode(const std::string &label, const mg::Map &params,
+               MemgraphClient &client);
+
+  /// <summary>
+  /// Stages a relationship to be MERGEd between two existing nodes.
+  /// </summary>
+  /// <returns>False if a value has a type CSV cannot carry, in which case the
+  /// caller must write the relationship itself.</returns>
+  /// <exception cref="std::runtime_error">Thrown if a file cannot be written
+  /// or a rotation's LOAD CSV fails.</exception>
+  bool AddRelationship(const std::string &from_label,
+                       const std::string &rel_type,
+                       const std::string &to_label, const mg::Map &params,
+                       MemgraphClient &client);
+
+  /// <summary>
+  /// Returns the number of staged rows that have not been loaded yet.
+  /// </summary>
+  size_t Pending() const;
+
+  /// <summary>
+  /// Loads every open file, node files first.
+  /// </summary>
+  /// <returns>The number of LOAD CSV queries executed.</returns>
+  size_t Flush(MemgraphClient &client);
+
+  /// <summary>
+  /// Drops all staged rows without loading them, e.g. after the transaction
+  /// they were meant for was rolled back.
+  /// </summary>
+  void Clear();
+
+private:
+  using FileKey = std::tuple<std::string, std::string, std::string>;
+
+  struct Column {
+    std::string name;
+    mg::Value::Type type;
+  };
+
+  /// <summary>
+  /// One open CSV file. Nodes use only 'from_label'.
+  /// </summary>
+  struct CsvFile {
+    std::string from_label;
+    std::string rel_type;
+    std::string to_label;
+    std::vector<Column> columns;
+    std::string name;
+    std::vector<char> buffer;
+    std::ofstream out;
+    size_t rows = 0;
+
+    bool IsRelationship() const { return !rel_type.empty(); }
+  };
+
+  /// <summary>
+  /// Writes one row into the file for 'key', rotating it first if the row
+  /// does not fit its columns.
+  /// </summary>
+  bool Add(const FileKey &key, const mg::Map &params, MemgraphClient &client);
+
+  /// <summary>
+  /// Opens a new file for 'key' with the given columns.
+  /// </summary>
+  std::unique_ptr<CsvFile> Open(const FileKey &key,
+                                std::vector<Column> columns);
+
+  /// <summary>
+  /// Closes the file for 'key' and runs its LOAD CSV query. Relationship
+  /// files load every pending node file first. The file and its rows are
+  /// dropped once loaded; if loading fails they stay pending and the file
+  /// is loaded again by the next Flush().
+  /// </summary>
+  void Load(const FileKey &key, MemgraphClient &client);
+
+  /// <summary>
+  /// Builds the LOAD CSV query for a finished file.
+  /// </summary>
+  std::string LoadQuery(const CsvFile &file) const;
+
+  CsvBulkLoaderOptions options;
+  size_t pending = 0;
+  size_t next_file = 0;
+  std::map<FileKey, std::unique_ptr<CsvFile>> files;
+};
+
+#endif // CSV_BULK_LOADER_H
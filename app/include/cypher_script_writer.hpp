@@ -0,0 +1,77 @@
+#ifndef CYPHER_SCRIPT_WRITER_H
+#define CYPHER_SCRIPT_WRITER_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../include/memgraph_client.hpp"
+
+/// <summary>
+/// A MemgraphClient that writes every query to a Cypher script instead of
+/// executing it. Parameters are inlined as Cypher literals, so the script can
+/// be replayed with 'mgconsole < script.cypherl'. Used by sync-replay to
+/// capture the exact writes the mapping layer produces.
+/// </summary>
+class CypherScriptWriter : public MemgraphClient {
+public:
+  /// <summary>
+  /// Opens (and truncates) the script file.
+  /// </summary>
+  /// <param name="path">The path of the script to write.</param>
+  /// <exception cref="std::runtime_error">Thrown if the file cannot be
+  /// opened.</exception>
+  explicit CypherScriptWriter(const std::string &path);
+
+  /// <summary>
+  /// Appends the query, with its parameters inlined, as one statement.
+  /// </summary>
+  void ExecuteQuery(const std::string &query, const mg::Map &params) override;
+
+  /// <summary>
+  /// Appends the query like ExecuteQuery(). Nothing is executed, so the
+  /// result is always 0, as for an empty database.
+  /// </summary>
+  int64_t ExecuteCountQuery(const std::string &query,
+                            const mg::Map &params) override;
+
+  /// <summary>
+  /// Returns false: the counts of a script are only known when it is
+  /// replayed.
+  /// </summary>
+  bool ReportsCounts() const override;
+
+  /// <summary>
+  /// Transactions are written as 'BEGIN', 'COMMIT' and 'ROLLBACK'
+  /// statements.
+  /// </summary>
+  void BeginTransaction() override;
+  void CommitTransaction() override;
+  void RollbackTransaction() override;
+
+  /// <summary>
+  /// Returns the number of statements written so far.
+  /// </summary>
+  size_t StatementsWritten() const;
+
+  /// <summary>
+  /// Replaces every '$name' in 'query' with the Cypher literal of the
+  /// parameter of that name. Unknown parameters are left as they are.
+  /// </summary>
+  static std::string InlineParams(const std::string &query,
+                                  const mg::Map &params);
+
+private:
+  /// <summary>
+  /// Appends one statement terminated by ';'.
+  /// </summary>
+  /// <exception cref="std::runtime_error">Thrown if the write
+  /// fails.</exception>
+  void Write(const std::string &statement);
+
+  std::vector<char> buffer;
+  std::ofstream out;
+  size_t statements = 0;
+};
+
+#endif // CYPHER_SCRIPT_WRITER_H
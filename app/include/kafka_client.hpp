@@ -1,10 +1,14 @@
 #ifndef KAFKA_CLIENT_H
 #define KAFKA_CLIENT_H
 
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 // 3rd-party library
@@ -17,6 +21,26 @@
 /// </summary>
 class KafkaClient {
 public:
+  /// <summary>
+  /// Returns the offset to start reading an assigned partition from, or -1 to
+  /// fall back to the consumer group's committed offset.
+  /// </summary>
+  using OffsetResolver =
+      std::function<int64_t(const std::string &topic, int32_t partition)>;
+
+  /// <summary>
+  /// (topic, partition) pairs.
+  /// </summary>
+  using Partitions = std::vector<std::pair<std::string, int32_t>>;
+
+  /// <summary>
+  /// Called with the partitions being revoked, before they are unassigned and
+  /// their stored offsets committed, e.g. to drop their consumed records and
+  /// store the offsets of those already applied through 'client'.
+  /// </summary>
+  using RevokeListener =
+      std::function<void(KafkaClient &client, const Partitions &partitions)>;
+
   /// <summary>
   /// Constructs a KafkaClient object, creating and configuring
   /// an underlying RdKafka::KafkaConsumer instance.
@@ -24,8 +48,14 @@ public:
   /// <param name="brokers">A string containing the comma-separated list of
   /// Kafka broker hostnames (e.g., "localhost:9092").</param> <param
   /// name="groupId">The consumer group ID that this client will be a part
-  /// of.</param>
-  KafkaClient(const std::string &brokers, const std::string &groupId);
+  /// of.</param> <param name="resolver">When set, consulted for every
+  /// partition Kafka assigns to this consumer, e.g. to resume from
+  /// checkpoints stored outside Kafka.</param> <param name="on_revoke">When
+  /// set, called before partitions are taken away from this
+  /// consumer.</param>
+  KafkaClient(const std::string &brokers, const std::string &groupId,
+              OffsetResolver resolver = nullptr,
+              RevokeListener on_revoke = nullptr);
 
   /// <summary>
   /// Destructor for the KafkaClient. It ensures that the underlying consumer
@@ -56,7 +86,66 @@ public:
   /// </returns>
   RdKafka::Message *Consume(int timeout_ms);
 
+  /// <summary>
+  /// Stores the offset to resume a partition from, to be committed with the
+  /// next auto-commit. Offsets are not stored automatically on consumption;
+  /// call this once the records before 'next_offset' have been applied.
+  /// </summary>
+  /// <param name="topic">The topic of the partition.</param>
+  /// <param name="partition">The partition.</param>
+  /// <param name="next_offset">One past the last applied offset.</param>
+  void StoreOffset(const std::string &topic, int32_t partition,
+                   int64_t next_offset);
+
+  /// <summary>
+  /// Stops fetching the assigned partitions of the given topics. The topics
+  /// stay paused across rebalances until resumed.
+  /// </summary>
+  /// <param name="topics">The topics to pause.</param>
+  void Pause(const std::vector<std::string> &topics);
+
+  /// <summary>
+  /// Resumes fetching the assigned partitions of the given topics.
+  /// </summary>
+  /// <param name="topics">The topics to resume.</param>
+  void Resume(const std::vector<std::string> &topics);
+
 private:
+  /// <summary>
+  /// Applies the OffsetResolver to partitions as they are assigned, keeps
+  /// paused topics paused and notifies the RevokeListener of revoked ones.
+  /// </summary>
+  class RebalanceHandler : public RdKafka::RebalanceCb {
+  public:
+    RebalanceHandler(KafkaClient &client, OffsetResolver resolver,
+                     RevokeListener on_revoke,
+                     const std::set<std::string> &paused_topics);
+    void rebalance_cb(RdKafka::KafkaConsumer *consumer, RdKafka::ErrorCode err,
+                      std::vector<RdKafka::TopicPartition *> &partitions)
+        override;
+
+  private:
+    KafkaClient &client;
+    OffsetResolver resolver;
+    RevokeListener on_revoke;
+    const std::set<std::string> &paused_topics;
+  };
+
+  /// <summary>
+  /// Pauses or resumes the assigned partitions of 'topics'.
+  /// </summary>
+  void SetPaused(const std::vector<std::string> &topics, bool pause);
+
+  /// <summary>
+  /// Topics paused with Pause(), re-paused whenever partitions are assigned.
+  /// </summary>
+  std::set<std::string> paused_topics;
+
+  /// <summary>
+  /// Must outlive 'consumer', which calls it until closed.
+  /// </summary>
+  std::unique_ptr<RebalanceHandler> rebalance_handler;
+
   /// <summary>
   /// A raw pointer to the underlying librdkafka consumer instance.
   /// </summary>
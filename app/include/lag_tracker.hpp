@@ -0,0 +1,111 @@
+#ifndef LAG_TRACKER_H
+#define LAG_TRACKER_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// The stages of the replication pipeline that lag is measured over.
+/// </summary>
+enum class LagStage {
+  /// <summary>
+  /// Source commit (payload.source.ts_ms) to Debezium emitting the event
+  /// (payload.ts_ms).
+  /// </summary>
+  Capture,
+  /// <summary>
+  /// Debezium emitting the event to the change being committed in Memgraph.
+  /// </summary>
+  Apply,
+  /// <summary>
+  /// Source commit to the change being committed in Memgraph.
+  /// </summary>
+  Total
+};
+
+/// <summary>
+/// Percentiles over the samples currently in a rolling window, in
+/// milliseconds.
+/// </summary>
+struct LagSummary {
+  size_t count = 0;
+  int64_t p50 = 0;
+  int64_t p95 = 0;
+  int64_t p99 = 0;
+  int64_t max = 0;
+};
+
+/// <summary>
+/// Tracks end-to-end replication lag per source table using the timestamps
+/// Debezium puts in every envelope. Each table keeps a fixed-size rolling
+/// window of samples per stage from which percentiles are computed on
+/// demand. All methods are thread-safe, so the status endpoint can read while
+/// the consumer loop records.
+/// </summary>
+class LagTracker {
+public:
+  /// <summary>
+  /// Constructs a LagTracker keeping the most recent 'window_size' samples
+  /// per table and stage.
+  /// </summary>
+  explicit LagTracker(size_t window_size = 1024);
+
+  /// <summary>
+  /// Records one applied event. Negative differences caused by clock skew
+  /// between hosts are clamped to zero.
+  /// </summary>
+  /// <param name="table">The source table, or "__heartbeat" for Debezium
+  /// heartbeats.</param> <param name="source_ts_ms">When the change was
+  /// committed in the source database.</param> <param name="emit_ts_ms">When
+  /// Debezium emitted the event.</param> <param name="applied_ts_ms">When the
+  /// change was committed in Memgraph.</param>
+  void Record(const std::string &table, int64_t source_ts_ms,
+              int64_t emit_ts_ms, int64_t applied_ts_ms);
+
+  /// <summary>
+  /// Returns the percentiles for one table and stage.
+  /// </summary>
+  LagSummary Summary(const std::string &table, LagStage stage) const;
+
+  /// <summary>
+  /// Renders every table's lag percentiles as a JSON document, as served on
+  /// the '/lag' status endpoint.
+  /// </summary>
+  std::string ToJson() const;
+
+  /// <summary>
+  /// Renders every table's lag percentiles in the Prometheus text exposition
+  /// format, as served on the '/metrics' status endpoint.
+  /// </summary>
+  std::string ToPrometheus() const;
+
+  /// <summary>
+  /// Returns the current wall-clock time in milliseconds since the epoch, the
+  /// same clock Debezium timestamps use.
+  /// </summary>
+  static int64_t NowMs();
+
+private:
+  /// <summary>
+  /// Rolling windows of samples for one table, one per LagStage, and the sum
+  /// of every sample ever recorded per stage.
+  /// </summary>
+  struct TableLag {
+    std::vector<int64_t> samples[3];
+    int64_t sums[3] = {0, 0, 0};
+    size_t next = 0;
+    size_t total = 0;
+    int64_t last_applied_ms = 0;
+  };
+
+  static LagSummary Summarize(const TableLag &lag, LagStage stage);
+
+  size_t window_size;
+  mutable std::mutex mutex;
+  std::map<std::string, TableLag> tables;
+};
+
+#endif // LAG_TRACKER_H
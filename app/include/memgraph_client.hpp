@@ -22,15 +22,17 @@ public:
   /// </summary>
   /// <param name="host">The hostname or IP address of the Memgraph
   /// server.</param> <param name="port">The port on which the Memgraph server
-  /// is running.</param> <exception cref="std::runtime_error">Thrown if the
+  /// is running.</param> <param name="dry_run">When true, no connection is
+  /// opened and queries are discarded. Used by tests and offline
+  /// tools.</param> <exception cref="std::runtime_error">Thrown if the
   /// connection to Memgraph fails.</exception>
-  MemgraphClient(const std::string &host, int port);
+  MemgraphClient(const std::string &host, int port, bool dry_run = false);
 
   /// <summary>
   /// Defaulted destructor. The std::unique_ptr member 'client' automatically
   /// handles the cleanup and disconnection from the Memgraph server.
   /// </summary>
-  ~MemgraphClient() = default;
+  virtual ~MemgraphClient() = default;
 
   // Disallow copy and assignment to prevent issues with resource ownership.
   MemgraphClient(const MemgraphClient &) = delete;
@@ -44,7 +46,48 @@ public:
   /// <param name="params">A constant reference to a map of parameters to be
   /// used in the query.</param> <exception cref="std::runtime_error">Thrown if
   /// the query execution fails.</exception>
-  void ExecuteQuery(const std::string &query, const mg::Map &params);
+  virtual void ExecuteQuery(const std::string &query, const mg::Map &params);
+
+  /// <summary>
+  /// Executes a Cypher query that returns a single integer, such as a
+  /// 'RETURN count(*)' query, and returns that integer.
+  /// </summary>
+  /// <param name="query">The Cypher query string to be executed.</param>
+  /// <param name="params">A constant reference to a map of parameters to be
+  /// used in the query.</param> <returns>The integer in the first column of
+  /// the first row, or 0 if the query returned no rows.</returns> <exception
+  /// cref="std::runtime_error">Thrown if the query execution fails.</exception>
+  virtual int64_t ExecuteCountQuery(const std::string &query,
+                                    const mg::Map &params);
+
+  /// <summary>
+  /// Returns whether ExecuteCountQuery() reports what the query returned.
+  /// Clients that only record queries return false, and callers then use a
+  /// form of the query that does not depend on the count.
+  /// </summary>
+  virtual bool ReportsCounts() const { return true; }
+
+  /// <summary>
+  /// Begins an explicit transaction. Queries executed until it is committed
+  /// or rolled back belong to it.
+  /// </summary>
+  /// <exception cref="std::runtime_error">Thrown if the transaction cannot be
+  /// started.</exception>
+  virtual void BeginTransaction();
+
+  /// <summary>
+  /// Commits the open explicit transaction.
+  /// </summary>
+  /// <exception cref="std::runtime_error">Thrown if the commit
+  /// fails.</exception>
+  virtual void CommitTransaction();
+
+  /// <summary>
+  /// Rolls back the open explicit transaction.
+  /// </summary>
+  /// <exception cref="std::runtime_error">Thrown if the rollback
+  /// fails.</exception>
+  virtual void RollbackTransaction();
 
   /// <summary>
   /// Runs a simple hardcoded query to test the connection and write
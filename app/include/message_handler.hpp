@@ -2,12 +2,316 @@
 #define MESSAGE_HANDLER_H
 
 #include "../external/json.hpp" // Adjust include path as needed
+#include "../include/column_plan.hpp"
+#include "../include/csv_bulk_loader.hpp"
+#include "../include/lag_tracker.hpp"
 #include "../include/memgraph_client.hpp"
 #include <librdkafka/rdkafkacpp.h>
+#include <map>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 // Alias for the nlohmann::json class for convenience.
 using json = nlohmann::json;
 
+/// <summary>
+/// Cache of generated Cypher query strings, keyed by operation and shape.
+/// </summary>
+using QueryCache = std::unordered_map<std::string, std::string>;
+
+/// <summary>
+/// Tunable behaviour for a MessageHandler.
+/// </summary>
+struct MessageHandlerOptions {
+  /// <summary>
+  /// When true, update events are diffed against the Debezium 'before' image
+  /// so that only changed columns are written and relationships whose FK
+  /// columns did not change are not re-MERGEd. Events with no graph-relevant
+  /// change are skipped entirely.
+  /// </summary>
+  bool diff_updates = true;
+
+  /// <summary>
+  /// Maximum number of buffered deletes sent in one UNWIND query. Node and
+  /// relationship deletes are buffered and flushed together once this many
+  /// are pending, before any non-delete event, or when Flush() is called.
+  /// A value of 0 or 1 executes every delete immediately.
+  /// </summary>
+  size_t delete_batch_size = 500;
+
+  /// <summary>
+  /// When true, snapshot ('r') events for a label that was empty when its
+  /// snapshot started are written with CREATE instead of MERGE. Incremental
+  /// snapshots, which interleave with streaming, always use MERGE.
+  /// </summary>
+  bool bulk_snapshots = true;
+
+  /// <summary>
+  /// When set, every applied row event and every Debezium heartbeat records
+  /// its replication lag here. Row events are recorded once their writes are
+  /// committed, i.e. after their buffered deletes, staged rows and
+  /// checkpointed transaction. Not owned by the handler.
+  /// </summary>
+  LagTracker *lag_tracker = nullptr;
+
+  /// <summary>
+  /// When set, rows on the append-only snapshot path are staged as CSV files
+  /// and loaded with LOAD CSV instead of one Bolt query per row. All other
+  /// events stay on Bolt; staged rows are loaded before any of them is
+  /// applied. Combined with checkpoints, files are loaded at every commit,
+  /// so a large 'checkpoint_interval' suits snapshot loads. Not owned by the
+  /// handler.
+  /// </summary>
+  CsvBulkLoader *bulk_loader = nullptr;
+
+  /// <summary>
+  /// When true, Process() applies messages inside explicit Memgraph
+  /// transactions and stores the last applied Kafka offset of every
+  /// partition as a 'SyncCheckpoint' node in the same transaction, so the
+  /// graph and its checkpoints never disagree. See ResumeOffset().
+  /// </summary>
+  bool checkpoints = false;
+
+  /// <summary>
+  /// Number of messages applied per checkpointed transaction. Flush() also
+  /// commits the open transaction.
+  /// </summary>
+  size_t checkpoint_interval = 100;
+
+  /// <summary>
+  /// When false, the per-event '[SUCCESS]' and '[SKIPPED]' lines and the
+  /// delete flush lines are not printed. Bulk tools such as sync-replay
+  /// turn this off.
+  /// </summary>
+  bool log_events = true;
+};
+
+/// <summary>
+/// Buffers node and relationship deletes and executes them as size-limited
+/// 'UNWIND $ids ... DETACH DELETE' queries. Relationship deletes whose
+/// endpoint node is itself pending an unguarded deletion (e.g. 'user_skills'
+/// rows removed along with their 'users' row) are dropped as redundant, since
+/// DETACH DELETE already removes them. A delete guarded by a source position
+/// may be rejected, so the relationship deletes under it are kept.
+/// </summary>
+class DeleteBatcher {
+public:
+  /// <summary>
+  /// Constructs a DeleteBatcher that flushes once 'max_batch_size' deletes
+  /// are pending, logging each flush when 'log_flushes' is true.
+  /// </summary>
+  explicit DeleteBatcher(size_t max_batch_size, bool log_flushes = true);
+
+  /// <summary>
+  /// Buffers the deletion of the node with the given label and id.
+  /// </summary>
+  /// <param name="source_position">The event's position in the source log,
+  /// or 0 if unknown. A node written by a newer event is kept.</param>
+  void AddNode(const std::string &label, const json &id,
+               int64_t source_position, MemgraphClient &client);
+
+  /// <summary>
+  /// Buffers the deletion of a relationship between two nodes.
+  /// </summary>
+  void AddRelationship(const std::string &from_label,
+                       const std::string &rel_type,
+                       const std::string &to_label, const json &from_id,
+                       const json &to_id, int64_t source_position,
+                       MemgraphClient &client);
+
+  /// <summary>
+  /// Deletes every node with the given label (a Debezium truncate), in
+  /// batches of at most 'max_batch_size' nodes per query.
+  /// </summary>
+  void TruncateLabel(const std::string &label, MemgraphClient &client);
+
+  /// <summary>
+  /// Deletes every relationship of the given shape, in batches of at most
+  /// 'max_batch_size' relationships per query.
+  /// </summary>
+  void TruncateRelationship(const std::string &from_label,
+                            const std::string &rel_type,
+                            const std::string &to_label,
+                            MemgraphClient &client);
+
+  /// <summary>
+  /// Returns the number of deletes waiting to be flushed.
+  /// </summary>
+  size_t Pending() const;
+
+  /// <summary>
+  /// Executes all buffered deletes. Each delete leaves the buffer once its
+  /// query has succeeded; if a query fails, the deletes that did not run stay
+  /// buffered for the next flush and the exception is rethrown.
+  /// </summary>
+  /// <returns>The number of queries executed.</returns>
+  size_t Flush(MemgraphClient &client);
+
+  /// <summary>
+  /// Drops all buffered deletes without executing them, e.g. after the
+  /// transaction they belonged to was rolled back.
+  /// </summary>
+  void Clear();
+
+private:
+  using RelKey = std::tuple<std::string, std::string, std::string>;
+
+  /// <summary>
+  /// One buffered delete. 'to_id' is only used for relationships.
+  /// </summary>
+  struct PendingDelete {
+    json id;
+    json to_id;
+    int64_t source_position;
+  };
+
+  /// <summary>
+  /// Returns the key of a node in 'node_positions'.
+  /// </summary>
+  static std::string NodeKey(const std::string &label, const json &id);
+
+  /// <summary>
+  /// Returns true if the node with the given label and id is pending a
+  /// deletion without a source position, which always removes its edges.
+  /// </summary>
+  bool Detaches(const std::string &label, const json &id) const;
+
+  /// <summary>
+  /// Deletes everything 'match' binds to 'var' with 'deletion', in batches
+  /// of 'LIMIT $limit ... RETURN count(*)' until one deletes less than a full
+  /// batch. A client that cannot report counts gets one unbounded query.
+  /// </summary>
+  void DeleteAll(const std::string &match, const std::string &var,
+                 const std::string &deletion, MemgraphClient &client);
+
+  size_t max_batch_size;
+  bool log_flushes;
+  size_t pending = 0;
+  std::map<std::string, std::vector<PendingDelete>> node_ids;
+  std::unordered_map<std::string, int64_t> node_positions;
+  std::map<RelKey, std::vector<PendingDelete>> rel_ids;
+};
+
+// --- Mapping Helpers ---
+
+/// <summary>
+/// Everything a mapper needs besides the row itself.
+/// </summary>
+struct MappingContext {
+  MemgraphClient &client;
+  QueryCache &query_cache;
+
+  /// <summary>
+  /// The Debezium before image of an update, or null. When set, mappers send
+  /// only changed columns and skip relationships whose FKs did not change.
+  /// </summary>
+  const json *before = nullptr;
+
+  /// <summary>
+  /// When set, deletes are buffered here instead of being executed, and
+  /// op 't' truncates through it.
+  /// </summary>
+  DeleteBatcher *deletes = nullptr;
+
+  /// <summary>
+  /// The event's position in the source log (see source_position()), or 0
+  /// if unknown. When known, every write is stored as the '_src_pos'
+  /// property of the node or edge it touches and only applies if it is not
+  /// older than the position already there, which makes replay idempotent.
+  /// </summary>
+  int64_t source_position = 0;
+
+  /// <summary>
+  /// When set, op 'r' rows are staged here for LOAD CSV instead of being
+  /// written with a query.
+  /// </summary>
+  CsvBulkLoader *bulk_loader = nullptr;
+
+  /// <summary>
+  /// The column plan of the event's table, derived from the envelope's
+  /// 'schema' block. Without one, columns are decoded by their JSON type.
+  /// </summary>
+  const ColumnPlan *columns = nullptr;
+};
+
+/// <summary>
+/// Converts a snake_case plural table name into a PascalCase singular node
+/// label (e.g. "user_skills" -> "UserSkill").
+/// </summary>
+std::string to_pascal_case(std::string s);
+
+/// <summary>
+/// Returns true if the column 'key' differs between the before and after
+/// images. A null 'before' means no before image is available, in which case
+/// every column is treated as changed.
+/// </summary>
+bool column_changed(const json *before, const json &after,
+                    const std::string &key);
+
+/// <summary>
+/// Returns a totally ordered position for a change from its Debezium
+/// 'source' block: the binlog file sequence, byte offset and row index for
+/// MySQL, or the LSN for PostgreSQL.
+/// </summary>
+/// <returns>The position, or 0 if the source carries none.</returns>
+int64_t source_position(const json &source);
+
+/// <summary>
+/// Upserts (or, for op 'd', detach-deletes) the node for a row. Op 'r' is an
+/// append-only snapshot insert and uses CREATE instead of MERGE.
+/// </summary>
+/// <returns>True if a query was executed or buffered.</returns>
+bool map_node(const json &data, char op, const std::string &label,
+              MappingContext &ctx);
+
+/// <summary>
+/// MERGEs (or, for op 'd', deletes) the relationship described by a pair of
+/// FK columns. When 'ctx.before' is given and neither FK changed, nothing is
+/// sent. Op 't' removes every relationship of this shape.
+/// </summary>
+/// <returns>True if a query was executed or buffered.</returns>
+bool map_relationship(const json &data, char op, const std::string &from_label,
+                      const std::string &to_label, const std::string &rel_type,
+                      const std::string &from_fk_col,
+                      const std::string &to_fk_col, MappingContext &ctx);
+
+/// <summary>
+/// Maintains a functional relationship: one derived from an FK column on the
+/// row itself, so the row's node has at most one such edge. Any write deletes
+/// the old edge and MERGEs the new one in a single query (or only deletes it
+/// when the FK is null), since the node may already exist, e.g. on a
+/// re-snapshot. Only append-only snapshot rows (op 'r') MERGE the edge alone.
+/// Nothing is sent when 'ctx.before' shows the FK unchanged.
+/// </summary>
+/// <param name="label">Label of the row's own node, matched on 'id'.</param>
+/// <param name="other_label">Label of the node referenced by 'fk_col'.</param>
+/// <param name="outgoing">True for (row)-[rel]->(other), false for
+/// (other)-[rel]->(row).</param>
+/// <returns>True if a query was executed.</returns>
+bool map_functional_relationship(const json &data, char op,
+                                 const std::string &label,
+                                 const std::string &other_label,
+                                 const std::string &rel_type,
+                                 const std::string &fk_col, bool outgoing,
+                                 MappingContext &ctx);
+
+/// <summary>
+/// Like map_relationship, additionally copying 'prop_keys' onto the edge.
+/// </summary>
+/// <returns>True if a query was executed or buffered.</returns>
+bool map_relationship_with_props(const json &data, char op,
+                                 const std::string &from_label,
+                                 const std::string &to_label,
+                                 const std::string &rel_type,
+                                 const std::string &from_fk_col,
+                                 const std::string &to_fk_col,
+                                 const std::vector<std::string> &prop_keys,
+                                 MappingContext &ctx);
+
 /// <summary>
 /// Handles the core business logic of the service.
 /// Its primary responsibility is to parse incoming Kafka messages, interpret
@@ -16,6 +320,12 @@ using json = nlohmann::json;
 /// </summary>
 class MessageHandler {
 public:
+  /// <summary>
+  /// Constructs a MessageHandler with the given options.
+  /// </summary>
+  explicit MessageHandler(
+      const MessageHandlerOptions &options = MessageHandlerOptions());
+
   /// <summary>
   /// Processes a single Kafka message, expected to be a Debezium CDC event in
   /// JSON format. It parses the message, identifies the database operation and
@@ -28,6 +338,166 @@ public:
   /// cref="std::runtime_error">Throws if message processing fails, e.g., due to
   /// JSON parsing errors.</exception>
   void Process(RdKafka::Message *msg, MemgraphClient &memgraphClient);
+
+  /// <summary>
+  /// Processes one Kafka record given as its raw value and coordinates. This
+  /// is what Process() does after unpacking the message: with checkpoints
+  /// enabled it applies the event inside the open transaction and records
+  /// the offset as the partition's pending checkpoint. A zero-length value is
+  /// a tombstone and only advances the checkpoint.
+  /// </summary>
+  /// <exception cref="std::runtime_error">Throws if the event cannot be
+  /// applied. With checkpoints enabled, the messages applied before it in the
+  /// same transaction are re-applied and the event is retried once before
+  /// that.</exception>
+  void ProcessRecord(std::string_view event, const std::string &topic,
+                     int32_t partition, int64_t offset,
+                     MemgraphClient &memgraphClient);
+
+  /// <summary>
+  /// Processes a single Debezium CDC event from its raw JSON text. This is the
+  /// Kafka-independent core of Process(). Every Debezium op is handled
+  /// explicitly: 'c' and 'u' upsert, 'r' (snapshot read) takes the bulk
+  /// insert path, 'd' deletes and 't' (truncate) clears the table's label.
+  /// Events without a row op, such as schema change events, and unknown ops
+  /// are ignored without throwing. Debezium heartbeats only record lag.
+  /// </summary>
+  /// <param name="event">The raw JSON of the Debezium envelope.</param>
+  /// <param name="memgraphClient">The client used for all database
+  /// interactions.</param> <returns>True if at least one query was executed,
+  /// false if the event was ignored or carried no graph-relevant
+  /// change.</returns>
+  bool ProcessEvent(std::string_view event, MemgraphClient &memgraphClient);
+
+  /// <summary>
+  /// Like ProcessEvent(), for an envelope that has already been parsed. Lets
+  /// callers parse events on other threads and apply them in order.
+  /// </summary>
+  bool ProcessParsedEvent(const json &dbz_event,
+                          MemgraphClient &memgraphClient);
+
+  /// <summary>
+  /// Executes any buffered deletes and, with checkpoints enabled, commits the
+  /// open transaction together with its checkpoints. Call this when the
+  /// consumer is idle and before shutting down so that no buffered work is
+  /// lost. If the commit fails, its messages are re-applied in a new
+  /// transaction for the next Flush() to commit, and the error is rethrown.
+  /// </summary>
+  /// <param name="memgraphClient">The client used for all database
+  /// interactions.</param>
+  void Flush(MemgraphClient &memgraphClient);
+
+  /// <summary>
+  /// Returns the offset to resume a partition from: one past the last offset
+  /// this handler applied, or else one past the checkpoint stored in
+  /// Memgraph. Used when Kafka assigns the partition.
+  /// </summary>
+  /// <returns>The offset, or -1 if the partition has no checkpoint.</returns>
+  int64_t ResumeOffset(const std::string &topic, int32_t partition,
+                       MemgraphClient &memgraphClient);
+
+  /// <summary>
+  /// The last offset applied per (topic, partition).
+  /// </summary>
+  using PartitionOffsets = std::map<std::pair<std::string, int32_t>, int64_t>;
+
+  /// <summary>
+  /// Returns, and forgets, the last offset per partition whose records are
+  /// all committed in Memgraph since the previous call: by their checkpointed
+  /// transaction, or else once none of their writes are buffered. Only these
+  /// offsets may be committed to Kafka, since records consumed but not yet
+  /// applied would otherwise be skipped after a crash.
+  /// </summary>
+  PartitionOffsets TakeCommittedOffsets();
+
+private:
+  /// <summary>
+  /// Decides whether a snapshot event for 'label' can take the append-only
+  /// CREATE path. The label is checked for emptiness on its first event of
+  /// each snapshot run, whose boundaries are the 'first' and 'last' markers
+  /// of 'source.snapshot'.
+  /// </summary>
+  bool SnapshotAppendOnly(const json &source, const std::string &label,
+                          MemgraphClient &memgraphClient);
+
+  /// <summary>
+  /// Records the lag of every event in 'pending_lag' as of now, once their
+  /// writes are committed.
+  /// </summary>
+  void RecordLag();
+
+  /// <summary>
+  /// Returns whether deletes or staged rows are waiting to be written.
+  /// </summary>
+  bool Buffered() const;
+
+  /// <summary>
+  /// Moves the offsets in 'pending_checkpoints' to 'committed_offsets' once
+  /// their writes are committed.
+  /// </summary>
+  void CommitOffsets();
+
+  /// <summary>
+  /// Begins a checkpointed transaction and re-applies the messages of the
+  /// previous one if it was rolled back before it could commit.
+  /// </summary>
+  /// <exception cref="std::runtime_error">Throws if the transaction cannot
+  /// be opened or the messages cannot be re-applied. They are kept for the
+  /// next attempt.</exception>
+  void BeginCheckpointTransaction(MemgraphClient &memgraphClient);
+
+  /// <summary>
+  /// Rolls back the open transaction after a failed message or commit and
+  /// re-applies the messages applied in it in a new one, so that at most the
+  /// failed message is lost. If that fails too, the messages stay pending
+  /// and are re-applied before the next commit.
+  /// </summary>
+  /// <returns>True if the new transaction is open with those messages
+  /// applied.</returns>
+  bool RecoverTransaction(MemgraphClient &memgraphClient);
+
+  MessageHandlerOptions options;
+  DeleteBatcher deletes;
+
+  /// <summary>
+  /// State of the open checkpointed transaction: whether one is open, the
+  /// messages applied in it and the last offset applied per partition. The
+  /// messages and offsets are only dropped once committed, so while no
+  /// transaction is open, pending offsets mean the messages must be
+  /// re-applied. Without checkpoints, the offsets are those of records with
+  /// writes still buffered.
+  /// </summary>
+  bool in_transaction = false;
+  std::vector<std::string> transaction_events;
+  PartitionOffsets pending_checkpoints;
+
+  /// <summary>
+  /// Offsets committed in Memgraph and not yet taken for Kafka.
+  /// </summary>
+  PartitionOffsets committed_offsets;
+
+  /// <summary>
+  /// Source and emit timestamps of applied events whose writes are not
+  /// committed yet.
+  /// </summary>
+  struct LagSample {
+    std::string table;
+    int64_t source_ms;
+    int64_t emit_ms;
+  };
+  std::vector<LagSample> pending_lag;
+
+  /// <summary>
+  /// Per-label append-only state for snapshot loads. A label leaves the
+  /// append-only state once any non-snapshot write touches it, until the
+  /// state is reset at the next snapshot boundary.
+  /// </summary>
+  std::unordered_map<std::string, bool> append_only_labels;
+
+  /// <summary>
+  /// Column plans per table, rebuilt when the table's schema changes.
+  /// </summary>
+  ColumnPlanCache column_plans;
 };
 
 #endif // MESSAGE_HANDLER_H
@@ -0,0 +1,176 @@
+#ifndef PRIORITY_SCHEDULER_H
+#define PRIORITY_SCHEDULER_H
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// <summary>
+/// Configuration of one priority lane.
+/// </summary>
+struct LaneConfig {
+  /// <summary>
+  /// Name used in logs and metrics.
+  /// </summary>
+  std::string name;
+
+  /// <summary>
+  /// Source tables routed to this lane. The first lane without tables is the
+  /// default lane for every table not listed elsewhere.
+  /// </summary>
+  std::vector<std::string> tables;
+
+  /// <summary>
+  /// Share of the apply capacity while several lanes have work queued. A
+  /// lane with weight 8 gets eight messages applied for every one of a lane
+  /// with weight 1.
+  /// </summary>
+  double weight = 1;
+
+  /// <summary>
+  /// Maximum number of messages applied per turn of this lane.
+  /// </summary>
+  size_t batch_size = 100;
+
+  /// <summary>
+  /// Latency target in milliseconds. A lane whose oldest queued message has
+  /// waited longer is served before the fair order. 0 disables it.
+  /// </summary>
+  int64_t max_latency_ms = 0;
+
+  /// <summary>
+  /// Queue length at which the lane's topics are paused in Kafka. They are
+  /// resumed once the queue has drained to half of it.
+  /// </summary>
+  size_t max_queued = 10000;
+};
+
+/// <summary>
+/// A consumed Kafka record waiting in a lane.
+/// </summary>
+struct QueuedRecord {
+  std::string topic;
+  int32_t partition = 0;
+  int64_t offset = 0;
+  std::string value;
+  int64_t enqueued_ms = 0;
+};
+
+/// <summary>
+/// A change of a lane's flow control state: its topics should be paused or
+/// resumed in Kafka.
+/// </summary>
+struct FlowChange {
+  std::vector<std::string> topics;
+  bool pause = false;
+};
+
+/// <summary>
+/// Splits consumed records into priority lanes by source table and decides
+/// which lane is applied next. Lanes share the single apply loop by weighted
+/// fair queueing: every lane carries a virtual finish time that advances by
+/// (messages applied / weight), and the lane with work queued and the
+/// smallest finish time goes next. A lane that has missed its latency target
+/// pre-empts that order. Records of one topic stay in one lane, so the order
+/// within every partition is preserved. Lanes whose queue runs full are
+/// reported for pausing, which keeps a backfilling table from crowding the
+/// others out of the consumer.
+///
+/// All methods are thread-safe, so metrics can be read from the status
+/// server thread.
+/// </summary>
+class PriorityScheduler {
+public:
+  /// <summary>
+  /// Constructs a scheduler with the given lanes.
+  /// </summary>
+  /// <exception cref="std::runtime_error">Thrown if there are no lanes or a
+  /// lane's weight or batch size is not positive.</exception>
+  explicit PriorityScheduler(std::vector<LaneConfig> lanes);
+
+  /// <summary>
+  /// Parses lane configurations from a JSON array of objects with the keys
+  /// of LaneConfig, e.g.
+  /// '[{"name": "interactive", "tables": ["users"], "weight": 8}]'.
+  /// </summary>
+  /// <exception cref="std::runtime_error">Thrown if the JSON is
+  /// invalid.</exception>
+  static std::vector<LaneConfig> LanesFromJson(const std::string &text);
+
+  /// <summary>
+  /// Returns the index of the lane for a Debezium topic, named
+  /// '<server>.<database>.<table>'. Unknown tables go to the default lane.
+  /// </summary>
+  size_t LaneFor(const std::string &topic);
+
+  /// <summary>
+  /// Returns the configuration of a lane.
+  /// </summary>
+  const LaneConfig &Config(size_t lane) const;
+
+  /// <summary>
+  /// Queues a consumed record in its lane.
+  /// </summary>
+  void Enqueue(QueuedRecord record);
+
+  /// <summary>
+  /// Removes and returns the next batch to apply, from a single lane.
+  /// </summary>
+  /// <param name="now_ms">The current time, for the latency targets.</param>
+  /// <returns>The batch, empty if nothing is queued.</returns>
+  std::vector<QueuedRecord> NextBatch(int64_t now_ms);
+
+  /// <summary>
+  /// Drops the queued records of the given (topic, partition) pairs, e.g.
+  /// when Kafka revokes them, since they are consumed again from the
+  /// committed offset by whichever consumer is assigned them next.
+  /// </summary>
+  /// <returns>The number of records dropped.</returns>
+  size_t DropPartitions(
+      const std::vector<std::pair<std::string, int32_t>> &partitions);
+
+  /// <summary>
+  /// Returns the lanes whose topics should be paused or resumed since the
+  /// last call.
+  /// </summary>
+  std::vector<FlowChange> UpdateFlowControl();
+
+  /// <summary>
+  /// Returns the number of records queued in all lanes.
+  /// </summary>
+  size_t Queued() const;
+
+  /// <summary>
+  /// Returns the number of records queued in one lane.
+  /// </summary>
+  size_t Queued(size_t lane) const;
+
+  /// <summary>
+  /// Renders per-lane queue length, applied count and head-of-line wait in
+  /// the Prometheus text exposition format.
+  /// </summary>
+  std::string ToPrometheus(int64_t now_ms) const;
+
+private:
+  struct Lane {
+    LaneConfig config;
+    std::deque<QueuedRecord> queue;
+    std::vector<std::string> topics;
+    double finish = 0;
+    size_t applied = 0;
+    bool paused = false;
+  };
+
+  std::vector<Lane> lanes;
+  size_t default_lane = 0;
+  std::map<std::string, size_t> table_lanes;
+  std::map<std::string, size_t> topic_lanes;
+  double virtual_time = 0;
+  mutable std::mutex mutex;
+};
+
+#endif // PRIORITY_SCHEDULER_H
@@ -0,0 +1,84 @@
+#ifndef STATUS_SERVER_H
+#define STATUS_SERVER_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+
+/// <summary>
+/// A minimal HTTP/1.1 server for read-only status endpoints such as '/lag'
+/// and '/metrics'. It runs on its own background thread, answers GET requests
+/// for registered paths and closes each connection after one response. It is
+/// intended for scraping and debugging, not for general HTTP traffic.
+/// </summary>
+class StatusServer {
+public:
+  /// <summary>
+  /// A handler producing the response body for one path.
+  /// </summary>
+  using Handler = std::function<std::string()>;
+
+  /// <summary>
+  /// Constructs a StatusServer that will listen on the given TCP port once
+  /// started.
+  /// </summary>
+  /// <param name="port">The TCP port to listen on.</param>
+  explicit StatusServer(int port);
+
+  /// <summary>
+  /// Destructor. Stops the server thread if it is still running.
+  /// </summary>
+  ~StatusServer();
+
+  // Disallow copy and assignment to prevent issues with resource ownership.
+  StatusServer(const StatusServer &) = delete;
+  StatusServer &operator=(const StatusServer &) = delete;
+
+  /// <summary>
+  /// Registers a handler for a path. Must be called before Start().
+  /// </summary>
+  /// <param name="path">The request path, e.g. "/lag". Query strings are
+  /// ignored when matching.</param> <param name="content_type">The
+  /// Content-Type of the response.</param> <param name="handler">Produces the
+  /// response body.</param>
+  void Route(const std::string &path, const std::string &content_type,
+             Handler handler);
+
+  /// <summary>
+  /// Binds the listening socket and starts serving on a background thread.
+  /// </summary>
+  /// <exception cref="std::runtime_error">Thrown if the socket cannot be
+  /// created or bound.</exception>
+  void Start();
+
+  /// <summary>
+  /// Stops serving and joins the background thread.
+  /// </summary>
+  void Stop();
+
+private:
+  struct Endpoint {
+    std::string content_type;
+    Handler handler;
+  };
+
+  /// <summary>
+  /// The accept loop run on the background thread.
+  /// </summary>
+  void Run();
+
+  /// <summary>
+  /// Reads one request from a connected client and writes the response.
+  /// </summary>
+  void HandleClient(int client_fd);
+
+  int port;
+  int listen_fd = -1;
+  std::atomic<bool> running{false};
+  std::thread thread;
+  std::map<std::string, Endpoint> endpoints;
+};
+
+#endif // STATUS_SERVER_H
@@ -0,0 +1,165 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// <summary>
+/// Records timed spans of the processing stages of sampled events into one
+/// ring buffer per thread and renders them in the Chrome trace event format,
+/// which chrome://tracing and Perfetto open directly.
+///
+/// Sampling is decided per event by TraceEvent: every Nth event of a thread
+/// is traced with all of its spans, and the spans of other events cost one
+/// thread-local check. Span names must be string literals; the detail (a
+/// topic, table or Cypher query) is interned per thread, so repeated query
+/// shapes are stored once.
+///
+/// Building with ENABLE_TRACING=OFF defines SYNC_DISABLE_TRACING, which turns
+/// the TRACE_* macros into no-ops so that no span code is compiled in.
+/// </summary>
+class Tracer {
+public:
+  /// <summary>
+  /// Returns the process-wide tracer.
+  /// </summary>
+  static Tracer &Instance();
+
+  /// <summary>
+  /// Sets the fraction of events to trace (0 disables tracing) and the
+  /// number of spans each thread's ring buffer keeps. Drops recorded spans.
+  /// </summary>
+  void Configure(double sample_rate, size_t buffer_spans);
+
+  /// <summary>
+  /// Counts one event on the calling thread and returns whether it is
+  /// sampled.
+  /// </summary>
+  bool ShouldSample();
+
+  /// <summary>
+  /// Records a finished span into the calling thread's ring buffer,
+  /// overwriting its oldest span when full.
+  /// </summary>
+  void Record(const char *name, std::string_view detail, int64_t start_ns,
+              int64_t duration_ns);
+
+  /// <summary>
+  /// Renders the spans of all threads as a Chrome trace JSON document.
+  /// </summary>
+  std::string ToChromeJson() const;
+
+  /// <summary>
+  /// Returns whether the calling thread is inside a sampled event.
+  /// </summary>
+  static bool Sampled();
+
+  /// <summary>
+  /// Marks the calling thread as inside a sampled event or not.
+  /// </summary>
+  static void SetSampled(bool sampled);
+
+  /// <summary>
+  /// Returns a monotonic timestamp in nanoseconds.
+  /// </summary>
+  static int64_t NowNs();
+
+private:
+  struct Buffer;
+
+  Tracer() = default;
+
+  /// <summary>
+  /// Returns the calling thread's buffer, registering it on first use.
+  /// </summary>
+  Buffer &ThreadBuffer();
+
+  std::atomic<uint64_t> sample_interval{0};
+  std::atomic<size_t> buffer_spans{65536};
+  mutable std::mutex mutex;
+  std::vector<std::shared_ptr<Buffer>> buffers;
+};
+
+/// <summary>
+/// Times one stage of a sampled event from construction until End() or
+/// destruction. Outside a sampled event it records nothing.
+/// </summary>
+class TraceSpan {
+public:
+  TraceSpan() = default;
+  TraceSpan(const char *name, std::string_view detail) { Start(name, detail); }
+  ~TraceSpan() { End(); }
+
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+
+  /// <summary>
+  /// Starts the span if the calling thread is inside a sampled event.
+  /// 'detail' must stay valid until the span ends.
+  /// </summary>
+  void Start(const char *name, std::string_view detail) {
+    if (!Tracer::Sampled())
+      return;
+    this->name = name;
+    this->detail = detail;
+    start_ns = Tracer::NowNs();
+  }
+
+  /// <summary>
+  /// Ends the span early.
+  /// </summary>
+  void End() {
+    if (start_ns < 0)
+      return;
+    Tracer::Instance().Record(name, detail, start_ns,
+                              Tracer::NowNs() - start_ns);
+    start_ns = -1;
+  }
+
+private:
+  const char *name = nullptr;
+  std::string_view detail;
+  int64_t start_ns = -1;
+};
+
+/// <summary>
+/// The root span of one event. Decides whether the event is sampled and, if
+/// so, traces it and every TraceSpan opened on this thread until it ends.
+/// </summary>
+class TraceEvent {
+public:
+  TraceEvent(const char *name, std::string_view detail)
+      : outer(Tracer::Sampled()) {
+    if (!outer && Tracer::Instance().ShouldSample())
+      Tracer::SetSampled(true);
+    span.Start(name, detail);
+  }
+  ~TraceEvent() {
+    span.End();
+    Tracer::SetSampled(outer);
+  }
+
+  TraceEvent(const TraceEvent &) = delete;
+  TraceEvent &operator=(const TraceEvent &) = delete;
+
+private:
+  bool outer;
+  TraceSpan span;
+};
+
+#ifndef SYNC_DISABLE_TRACING
+#define TRACE_EVENT(var, name, detail) TraceEvent var(name, detail)
+#define TRACE_SPAN(var, name, detail) TraceSpan var(name, detail)
+#define TRACE_END(var) var.End()
+#else
+#define TRACE_EVENT(var, name, detail) static_cast<void>(0)
+#define TRACE_SPAN(var, name, detail) static_cast<void>(0)
+#define TRACE_END(var) static_cast<void>(0)
+#endif
+
+#endif // TRACER_H
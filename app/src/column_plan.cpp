@@ -0,0 +1,413 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+#include "../include/column_plan.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+constexpr int64_t kNanosPerSecond = 1000000000;
+constexpr int64_t kSecondsPerDay = 86400;
+
+// Above this many digits a Decimal no longer round-trips through a double.
+constexpr int kMaxDoublePrecision = 15;
+
+int64_t floor_div(int64_t a, int64_t b) {
+  return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+/// <summary>
+/// Decodes standard base64, as Kafka Connect encodes 'bytes' fields.
+/// </summary>
+/// <returns>False if 'in' is not valid base64.</returns>
+bool base64_decode(const std::string &in, std::string &out) {
+  out.clear();
+  uint32_t buffer = 0;
+  int bits = 0;
+  for (char c : in) {
+    int v;
+    if (c >= 'A' && c <= 'Z')
+      v = c - 'A';
+    else if (c >= 'a' && c <= 'z')
+      v = c - 'a' + 26;
+    else if (c >= '0' && c <= '9')
+      v = c - '0' + 52;
+    else if (c == '+')
+      v = 62;
+    else if (c == '/')
+      v = 63;
+    else if (c == '=')
+      break;
+    else
+      return false;
+    buffer = (buffer << 6) | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out += static_cast<char>((buffer >> bits) & 0xFF);
+    }
+  }
+  return true;
+}
+
+/// <summary>
+/// Formats a big-endian two's complement unscaled value with 'scale'
+/// fractional digits, e.g. 0x04D2 with scale 2 as "12.34".
+/// </summary>
+std::string format_decimal(const std::string &bytes, int scale) {
+  std::vector<uint8_t> magnitude(bytes.begin(), bytes.end());
+  const bool negative = !magnitude.empty() && (magnitude[0] & 0x80);
+  if (negative) {
+    for (uint8_t &b : magnitude)
+      b = ~b;
+    for (size_t i = magnitude.size(); i-- > 0;)
+      if (++magnitude[i] != 0)
+        break;
+  }
+
+  // Repeated division by ten of the base-256 magnitude.
+  std::string digits;
+  size_t start = 0;
+  while (start < magnitude.size()) {
+    unsigned remainder = 0;
+    for (size_t i = start; i < magnitude.size(); ++i) {
+      const unsigned current = (remainder << 8) | magnitude[i];
+      magnitude[i] = static_cast<uint8_t>(current / 10);
+      remainder = current % 10;
+    }
+    digits += static_cast<char>('0' + remainder);
+    while (start < magnitude.size() && magnitude[start] == 0)
+      ++start;
+  }
+  if (digits.empty())
+    digits = "0";
+  std::reverse(digits.begin(), digits.end());
+
+  if (scale > 0) {
+    if (digits.size() <= static_cast<size_t>(scale))
+      digits.insert(0, scale - digits.size() + 1, '0');
+    digits.insert(digits.size() - scale, 1, '.');
+  } else if (scale < 0) {
+    digits.append(-scale, '0');
+  }
+  return negative ? "-" + digits : digits;
+}
+
+mg::Value decode_int(const json &value, const ColumnSpec &) {
+  if (!value.is_number_integer())
+    return ColumnPlan::DecodeJson(value);
+  return mg::Value(value.get<int64_t>());
+}
+
+mg::Value decode_double(const json &value, const ColumnSpec &) {
+  if (!value.is_number())
+    return ColumnPlan::DecodeJson(value);
+  return mg::Value(value.get<double>());
+}
+
+mg::Value decode_string(const json &value, const ColumnSpec &) {
+  if (!value.is_string())
+    return ColumnPlan::DecodeJson(value);
+  return mg::Value(value.get_ref<const std::string &>());
+}
+
+mg::Value decode_as_json(const json &value, const ColumnSpec &) {
+  return ColumnPlan::DecodeJson(value);
+}
+
+mg::Value decode_decimal_string(const json &value, const ColumnSpec &column) {
+  std::string bytes;
+  if (!value.is_string() ||
+      !base64_decode(value.get_ref<const std::string &>(), bytes))
+    return ColumnPlan::DecodeJson(value);
+  return mg::Value(format_decimal(bytes, column.scale));
+}
+
+mg::Value decode_decimal_double(const json &value, const ColumnSpec &column) {
+  std::string bytes;
+  if (!value.is_string() ||
+      !base64_decode(value.get_ref<const std::string &>(), bytes))
+    return decode_double(value, column);
+  if (bytes.size() > 8)
+    return mg::Value(
+        std::strtod(format_decimal(bytes, column.scale).c_str(), nullptr));
+  uint64_t unscaled = !bytes.empty() && (bytes[0] & 0x80) ? ~0ULL : 0;
+  for (char b : bytes)
+    unscaled = (unscaled << 8) | static_cast<uint8_t>(b);
+  return mg::Value(static_cast<double>(static_cast<int64_t>(unscaled)) /
+                   std::pow(10.0, column.scale));
+}
+
+// io.debezium.data.VariableScaleDecimal is a struct of 'scale' and 'value'.
+mg::Value decode_variable_decimal(const json &value, const ColumnSpec &) {
+  auto scale = value.find("scale");
+  auto unscaled = value.find("value");
+  std::string bytes;
+  if (!value.is_object() || scale == value.end() ||
+      !scale->is_number_integer() || unscaled == value.end() ||
+      !unscaled->is_string() ||
+      !base64_decode(unscaled->get_ref<const std::string &>(), bytes))
+    return ColumnPlan::DecodeJson(value);
+  return mg::Value(format_decimal(bytes, scale->get<int>()));
+}
+
+mg::Value decode_date(const json &value, const ColumnSpec &) {
+  if (!value.is_number_integer())
+    return ColumnPlan::DecodeJson(value);
+  return mg::Value(mg::Date(value.get<int64_t>()));
+}
+
+template <int64_t kUnitsPerSecond>
+mg::Value decode_timestamp(const json &value, const ColumnSpec &) {
+  if (!value.is_number_integer())
+    return ColumnPlan::DecodeJson(value);
+  const int64_t units = value.get<int64_t>();
+  const int64_t seconds = floor_div(units, kUnitsPerSecond);
+  const int64_t nanoseconds =
+      (units - seconds * kUnitsPerSecond) * (kNanosPerSecond / kUnitsPerSecond);
+  return mg::Value(mg::LocalDateTime(seconds, nanoseconds));
+}
+
+template <int64_t kUnitsPerSecond>
+mg::Value decode_time(const json &value, const ColumnSpec &) {
+  if (!value.is_number_integer())
+    return ColumnPlan::DecodeJson(value);
+  return mg::Value(mg::LocalTime(value.get<int64_t>() *
+                                 (kNanosPerSecond / kUnitsPerSecond)));
+}
+
+/// <summary>
+/// Picks the decoder for one field of a row struct schema.
+/// </summary>
+ColumnSpec plan_column(const json &field) {
+  ColumnSpec column;
+  column.name = field.value("field", "");
+  const std::string type = field.value("type", "");
+  const std::string logical = field.value("name", "");
+
+  if (logical == "org.apache.kafka.connect.data.Decimal") {
+    int precision = std::numeric_limits<int>::max();
+    auto parameters = field.find("parameters");
+    if (parameters != field.end() && parameters->is_object()) {
+      column.scale = std::atoi(parameters->value("scale", "0").c_str());
+      const std::string p =
+          parameters->value("connect.decimal.precision", "");
+      if (!p.empty())
+        precision = std::atoi(p.c_str());
+    }
+    column.decode = precision <= kMaxDoublePrecision ? decode_decimal_double
+                                                     : decode_decimal_string;
+  } else if (logical == "io.debezium.data.VariableScaleDecimal") {
+    column.decode = decode_variable_decimal;
+  } else if (logical == "io.debezium.time.Date" ||
+             logical == "org.apache.kafka.connect.data.Date") {
+    column.decode = decode_date;
+  } else if (logical == "io.debezium.time.Timestamp" ||
+             logical == "org.apache.kafka.connect.data.Timestamp") {
+    column.decode = decode_timestamp<1000>;
+  } else if (logical == "io.debezium.time.MicroTimestamp") {
+    column.decode = decode_timestamp<1000000>;
+  } else if (logical == "io.debezium.time.NanoTimestamp") {
+    column.decode = decode_timestamp<kNanosPerSecond>;
+  } else if (logical == "io.debezium.time.Time" ||
+             logical == "org.apache.kafka.connect.data.Time") {
+    column.decode = decode_time<1000>;
+  } else if (logical == "io.debezium.time.MicroTime") {
+    column.decode = decode_time<1000000>;
+  } else if (logical == "io.debezium.time.NanoTime") {
+    column.decode = decode_time<kNanosPerSecond>;
+  } else if (type == "int8" || type == "int16" || type == "int32" ||
+             type == "int64") {
+    column.decode = decode_int;
+  } else if (type == "float" || type == "float32" || type == "float64" ||
+             type == "double") {
+    column.decode = decode_double;
+  } else if (type == "string") {
+    // Also zoned timestamps, JSON documents and enums, which Debezium sends
+    // as strings.
+    column.decode = decode_string;
+  } else {
+    column.decode = decode_as_json;
+  }
+  return column;
+}
+
+} // namespace
+
+/// <summary>
+/// Builds the plan for a Debezium row struct schema.
+/// </summary>
+ColumnPlan::ColumnPlan(const json &row_schema) {
+  auto fields = row_schema.find("fields");
+  if (fields == row_schema.end() || !fields->is_array())
+    return;
+  for (const json &field : *fields) {
+    if (field.is_object())
+      columns.push_back(plan_column(field));
+  }
+  std::sort(columns.begin(), columns.end(),
+            [](const ColumnSpec &a, const ColumnSpec &b) {
+              return a.name < b.name;
+            });
+}
+
+/// <summary>
+/// Decodes the value of column 'name' with its planned decoder.
+/// </summary>
+mg::Value ColumnPlan::Decode(const std::string &name,
+                             const json &value) const {
+  if (value.is_null())
+    return mg::Value();
+  auto it = std::lower_bound(
+      columns.begin(), columns.end(), name,
+      [](const ColumnSpec &c, const std::string &n) { return c.name < n; });
+  if (it == columns.end() || it->name != name)
+    return DecodeJson(value);
+  return it->decode(value, *it);
+}
+
+/// <summary>
+/// Decodes the value of the column at 'index', falling back to the lookup
+/// by name if the row does not have the planned columns.
+/// </summary>
+mg::Value ColumnPlan::Decode(size_t index, const std::string &name,
+                             const json &value) const {
+  if (index >= columns.size() || columns[index].name != name)
+    return Decode(name, value);
+  if (value.is_null())
+    return mg::Value();
+  return columns[index].decode(value, columns[index]);
+}
+
+/// <summary>
+/// Returns the planned columns, sorted by name.
+/// </summary>
+const std::vector<ColumnSpec> &ColumnPlan::Columns() const { return columns; }
+
+/// <summary>
+/// Decodes a value by its JSON type: integers as 64-bit Int, arrays and
+/// objects as List and Map.
+/// </summary>
+mg::Value ColumnPlan::DecodeJson(const json &value) {
+  switch (value.type()) {
+  case json::value_t::boolean:
+    return mg::Value(value.get<bool>());
+  case json::value_t::number_integer:
+    return mg::Value(value.get<int64_t>());
+  case json::value_t::number_unsigned: {
+    const uint64_t u = value.get<uint64_t>();
+    if (u > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+      return mg::Value(static_cast<double>(u));
+    return mg::Value(static_cast<int64_t>(u));
+  }
+  case json::value_t::number_float:
+    return mg::Value(value.get<double>());
+  case json::value_t::string:
+    return mg::Value(value.get_ref<const std::string &>());
+  case json::value_t::array: {
+    mg::List list(value.size());
+    for (const json &item : value)
+      list.Append(DecodeJson(item));
+    return mg::Value(std::move(list));
+  }
+  case json::value_t::object: {
+    mg::Map map(value.size());
+    for (const auto &[key, item] : value.items())
+      map.Insert(key, DecodeJson(item));
+    return mg::Value(std::move(map));
+  }
+  default:
+    return mg::Value();
+  }
+}
+
+/// <summary>
+/// Returns the plan for the row schema in a Debezium envelope schema,
+/// rebuilding the table's plan if its schema changed.
+/// </summary>
+const ColumnPlan *ColumnPlanCache::Get(const std::string &table,
+                                       const json &envelope_schema) {
+  auto fields = envelope_schema.find("fields");
+  if (fields == envelope_schema.end() || !fields->is_array())
+    return nullptr;
+  const json *row_schema = nullptr;
+  for (const json &field : *fields) {
+    if (!field.is_object() || !field.contains("fields"))
+      continue;
+    const std::string name = field.value("field", "");
+    if (name == "after" || (name == "before" && !row_schema))
+      row_schema = &field;
+  }
+  if (!row_schema)
+    return nullptr;
+
+  // Comparing with the planned schema stops at the first difference and
+  // allocates nothing, unlike planning it again.
+  Entry &entry = plans[table];
+  if (!entry.plan || entry.schema != *row_schema) {
+    if (entry.plan)
+      std::cout << "[SUCCESS] Schema of table '" << table
+                << "' changed, rebuilt its column plan" << std::endl;
+    entry.plan = std::make_unique<ColumnPlan>(*row_schema);
+    entry.schema = *row_schema;
+  }
+  return entry.plan.get();
+}
+
+/// <summary>
+/// Formats days since the epoch as 'YYYY-MM-DD' (proleptic Gregorian).
+/// </summary>
+std::string format_date(int64_t days) {
+  // Civil-from-days, after Howard Hinnant's date algorithms.
+  const int64_t z = days + 719468;
+  const int64_t era = floor_div(z, 146097);
+  const int64_t doe = z - era * 146097;
+  const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const int64_t mp = (5 * doy + 2) / 153;
+  const int64_t day = doy - (153 * mp + 2) / 5 + 1;
+  const int64_t month = mp < 10 ? mp + 3 : mp - 9;
+  const int64_t year = yoe + era * 400 + (month <= 2);
+  // Room for three 64-bit fields of up to 20 characters each.
+  char text[64];
+  std::snprintf(text, sizeof(text), "%04lld-%02lld-%02lld",
+                static_cast<long long>(year), static_cast<long long>(month),
+                static_cast<long long>(day));
+  return text;
+}
+
+/// <summary>
+/// Formats nanoseconds since midnight as 'hh:mm:ss[.ffffff]'.
+/// </summary>
+std::string format_local_time(int64_t nanoseconds) {
+  const int64_t seconds = floor_div(nanoseconds, kNanosPerSecond);
+  const int64_t micros = (nanoseconds - seconds * kNanosPerSecond) / 1000;
+  const int64_t of_day =
+      seconds - floor_div(seconds, kSecondsPerDay) * kSecondsPerDay;
+  char text[32];
+  int length = std::snprintf(
+      text, sizeof(text), "%02lld:%02lld:%02lld",
+      static_cast<long long>(of_day / 3600),
+      static_cast<long long>(of_day / 60 % 60),
+      static_cast<long long>(of_day % 60));
+  if (micros > 0)
+    std::snprintf(text + length, sizeof(text) - length, ".%06lld",
+                  static_cast<long long>(micros));
+  return text;
+}
+
+/// <summary>
+/// Formats a local date-time as 'YYYY-MM-DDThh:mm:ss[.ffffff]'.
+/// </summary>
+std::string format_local_date_time(int64_t seconds, int64_t nanoseconds) {
+  const int64_t days = floor_div(seconds, kSecondsPerDay);
+  return format_date(days) + "T" +
+         format_local_time((seconds - days * kSecondsPerDay) *
+                               kNanosPerSecond +
+                           nanoseconds);
+}
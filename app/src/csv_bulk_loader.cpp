@@ -0,0 +1,363 @@
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+#include "../include/column_plan.hpp"
+#include "../include/csv_bulk_loader.hpp"
+
+namespace {
+
+// Each open file writes in blocks of this size.
+constexpr size_t kBufferSize = 1 << 20;
+
+// Written for missing and null values and turned back into null by NULLIF.
+constexpr const char *kNullField = "\\N";
+
+/// <summary>
+/// One flattened row value, already encoded as a CSV field.
+/// </summary>
+struct Field {
+  std::string name;
+  mg::Value::Type type;
+  std::string text;
+};
+
+// Templated because the map accessors of mgclient yield const views rather
+// than mg::Value itself.
+template <typename V> bool encode_field(const V &value, std::string &text) {
+  switch (value.type()) {
+  case mg::Value::Type::Bool:
+    text = value.ValueBool() ? "true" : "false";
+    return true;
+  case mg::Value::Type::Int:
+    text = std::to_string(value.ValueInt());
+    return true;
+  case mg::Value::Type::Double: {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.17g", value.ValueDouble());
+    text = number;
+    return true;
+  }
+  case mg::Value::Type::String: {
+    const std::string_view s = value.ValueString();
+    text.assign(1, '"');
+    for (char c : s) {
+      if (c == '"')
+        text += '"';
+      text += c;
+    }
+    text += '"';
+    return true;
+  }
+  case mg::Value::Type::Date:
+    text = format_date(value.ValueDate().days());
+    return true;
+  case mg::Value::Type::LocalTime:
+    text = format_local_time(value.ValueLocalTime().nanoseconds());
+    return true;
+  case mg::Value::Type::LocalDateTime: {
+    const auto date_time = value.ValueLocalDateTime();
+    text = format_local_date_time(date_time.seconds(),
+                                  date_time.nanoseconds());
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+/// <summary>
+/// Flattens a mapper's parameter map into fields: top-level scalars keep
+/// their name ('src_pos' becomes the '_src_pos' property) and the entries of
+/// 'props' become one field each. Nulls are left out.
+/// </summary>
+/// <returns>False if a value cannot be written to CSV.</returns>
+bool flatten(const mg::Map &params, std::vector<Field> &fields) {
+  auto add = [&fields](std::string name, const auto &value) {
+    if (value.type() == mg::Value::Type::Null)
+      return true;
+    Field field{std::move(name), value.type(), ""};
+    if (!encode_field(value, field.text))
+      return false;
+    fields.push_back(std::move(field));
+    return true;
+  };
+  for (const auto &[key, value] : params) {
+    if (value.type() == mg::Value::Type::Map) {
+      for (const auto &[prop_key, prop_value] : value.ValueMap()) {
+        if (!add(std::string(prop_key), prop_value))
+          return false;
+      }
+    } else if (!add(key == "src_pos" ? "_src_pos" : std::string(key), value)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// <summary>
+/// Returns the Cypher expression that turns a CSV field back into its type.
+/// </summary>
+std::string convert(const std::string &name, mg::Value::Type type) {
+  const std::string field = "row.`" + name + "`";
+  switch (type) {
+  case mg::Value::Type::Int:
+    return "toInteger(" + field + ")";
+  case mg::Value::Type::Double:
+    return "toFloat(" + field + ")";
+  case mg::Value::Type::Bool:
+    return "(" + field + " = 'true')";
+  case mg::Value::Type::Date:
+    return "CASE WHEN " + field + " IS NULL THEN null ELSE date(" + field +
+           ") END";
+  case mg::Value::Type::LocalTime:
+    return "CASE WHEN " + field + " IS NULL THEN null ELSE localTime(" +
+           field + ") END";
+  case mg::Value::Type::LocalDateTime:
+    return "CASE WHEN " + field + " IS NULL THEN null ELSE localDateTime(" +
+           field + ") END";
+  default:
+    return field;
+  }
+}
+
+} // namespace
+
+/// <summary>
+/// Constructs a CsvBulkLoader writing to 'options.directory'.
+/// </summary>
+CsvBulkLoader::CsvBulkLoader(const CsvBulkLoaderOptions &options)
+    : options(options) {
+  if (options.directory.empty()) {
+    throw std::runtime_error("CsvBulkLoader needs a directory.");
+  }
+}
+
+/// <summary>
+/// Closes and removes any files that were never loaded.
+/// </summary>
+CsvBulkLoader::~CsvBulkLoader() { Clear(); }
+
+/// <summary>
+/// Stages a node to be CREATEd.
+/// </summary>
+bool CsvBulkLoader::AddNode(const std::string &label, const mg::Map &params,
+                            MemgraphClient &client) {
+  return Add({label, "", ""}, params, client);
+}
+
+/// <summary>
+/// Stages a relationship to be MERGEd between two existing nodes.
+/// </summary>
+bool CsvBulkLoader::AddRelationship(const std::string &from_label,
+                                    const std::string &rel_type,
+                                    const std::string &to_label,
+                                    const mg::Map &params,
+                                    MemgraphClient &client) {
+  return Add({from_label, rel_type, to_label}, params, client);
+}
+
+/// <summary>
+/// Returns the number of staged rows that have not been loaded yet.
+/// </summary>
+size_t CsvBulkLoader::Pending() const { return pending; }
+
+/// <summary>
+/// Loads every open file, node files first.
+/// </summary>
+size_t CsvBulkLoader::Flush(MemgraphClient &client) {
+  std::vector<FileKey> nodes, relationships;
+  for (const auto &[key, file] : files)
+    (file->IsRelationship() ? relationships : nodes).push_back(key);
+  for (const auto &key : nodes)
+    Load(key, client);
+  for (const auto &key : relationships)
+    Load(key, client);
+  return nodes.size() + relationships.size();
+}
+
+/// <summary>
+/// Drops all staged rows without loading them.
+/// </summary>
+void CsvBulkLoader::Clear() {
+  for (auto &[key, file] : files) {
+    file->out.close();
+    std::remove((options.directory + "/" + file->name).c_str());
+  }
+  files.clear();
+  pending = 0;
+}
+
+/// <summary>
+/// Writes one row into the file for 'key', rotating it first if the row adds
+/// a column or changes a column's type.
+/// </summary>
+bool CsvBulkLoader::Add(const FileKey &key, const mg::Map &params,
+                        MemgraphClient &client) {
+  std::vector<Field> fields;
+  if (!flatten(params, fields))
+    return false;
+
+  auto it = files.find(key);
+  std::vector<Column> columns;
+  if (it != files.end())
+    columns = it->second->columns;
+  // A file that failed to load is closed and has to be loaded first.
+  bool fits = it != files.end() && it->second->out.is_open();
+  for (const Field &field : fields) {
+    auto column = std::find_if(
+        columns.begin(), columns.end(),
+        [&field](const Column &c) { return c.name == field.name; });
+    if (column == columns.end()) {
+      columns.push_back({field.name, field.type});
+      fits = false;
+    } else if (column->type != field.type) {
+      column->type = field.type;
+      fits = false;
+    }
+  }
+  if (!fits) {
+    Load(key, client);
+    it = files.emplace(key, Open(key, std::move(columns))).first;
+  }
+
+  CsvFile &file = *it->second;
+  std::string line;
+  for (size_t i = 0; i < file.columns.size(); ++i) {
+    if (i > 0)
+      line += ',';
+    auto field = std::find_if(
+        fields.begin(), fields.end(),
+        [&](const Field &f) { return f.name == file.columns[i].name; });
+    line += field == fields.end() ? kNullField : field->text;
+  }
+  line += '\n';
+  file.out << line;
+  if (!file.out) {
+    throw std::runtime_error("Failed to write CSV file " + file.name);
+  }
+  ++file.rows;
+  ++pending;
+
+  if (options.rotate_rows > 0 && file.rows >= options.rotate_rows)
+    Load(key, client);
+  return true;
+}
+
+/// <summary>
+/// Opens a new file for 'key' and writes its header.
+/// </summary>
+std::unique_ptr<CsvBulkLoader::CsvFile>
+CsvBulkLoader::Open(const FileKey &key, std::vector<Column> columns) {
+  auto file = std::make_unique<CsvFile>();
+  std::tie(file->from_label, file->rel_type, file->to_label) = key;
+  file->columns = std::move(columns);
+  file->name = file->IsRelationship() ? file->from_label + "_" +
+                                            file->rel_type + "_" +
+                                            file->to_label
+                                      : file->from_label;
+  file->name += "." + std::to_string(next_file++) + ".csv";
+
+  file->buffer.resize(kBufferSize);
+  file->out.rdbuf()->pubsetbuf(file->buffer.data(), file->buffer.size());
+  file->out.open(options.directory + "/" + file->name,
+                 std::ios::out | std::ios::trunc);
+  if (!file->out) {
+    throw std::runtime_error("Failed to open CSV file " + options.directory +
+                             "/" + file->name);
+  }
+  for (size_t i = 0; i < file->columns.size(); ++i)
+    file->out << (i > 0 ? "," : "") << file->columns[i].name;
+  file->out << '\n';
+  return file;
+}
+
+/// <summary>
+/// Closes the file for 'key' and loads it. Relationship files load every
+/// pending node file first, so that their endpoints exist.
+/// </summary>
+void CsvBulkLoader::Load(const FileKey &key, MemgraphClient &client) {
+  auto it = files.find(key);
+  if (it == files.end())
+    return;
+  CsvFile &file = *it->second;
+
+  if (file.IsRelationship()) {
+    std::vector<FileKey> nodes;
+    for (const auto &[other_key, other] : files)
+      if (!other->IsRelationship())
+        nodes.push_back(other_key);
+    for (const auto &node_key : nodes)
+      Load(node_key, client);
+  }
+
+  // A file whose load failed is already closed and is loaded again as is.
+  const std::string path = options.directory + "/" + file.name;
+  if (file.out.is_open()) {
+    file.out.close();
+    if (!file.out) {
+      throw std::runtime_error("Failed to write CSV file " + path);
+    }
+  }
+  if (file.rows > 0) {
+    const mg::Map params(0);
+    try {
+      client.ExecuteQuery(LoadQuery(file), params);
+    } catch (const std::exception &e) {
+      std::cerr << "[ERROR] LOAD CSV failed, keeping " << path
+                << " for the next flush" << std::endl;
+      throw;
+    }
+    if (options.log_events)
+      std::cout << "[SUCCESS] Loaded " << file.rows << " rows from "
+                << file.name << std::endl;
+  }
+  // The rows only stop being pending once they are in Memgraph.
+  std::remove(path.c_str());
+  pending -= file.rows;
+  files.erase(it);
+}
+
+/// <summary>
+/// Builds the LOAD CSV query for a finished file: CREATE for nodes, MATCH on
+/// both endpoints and MERGE for relationships, then one SET per property.
+/// </summary>
+std::string CsvBulkLoader::LoadQuery(const CsvFile &file) const {
+  const std::string &directory = options.load_directory.empty()
+                                     ? options.directory
+                                     : options.load_directory;
+  std::string query = "LOAD CSV FROM '" + directory + "/" + file.name +
+                      "' WITH HEADER NULLIF '\\\\N' AS row ";
+
+  auto type_of = [&file](const std::string &name) {
+    for (const Column &column : file.columns)
+      if (column.name == name)
+        return column.type;
+    return mg::Value::Type::Null;
+  };
+  std::string var;
+  if (file.IsRelationship()) {
+    var = "r";
+    query += "MATCH (a:" + file.from_label + " {id: " +
+             convert("from_id", type_of("from_id")) + "}) MATCH (b:" +
+             file.to_label + " {id: " + convert("to_id", type_of("to_id")) +
+             "}) MERGE (a)-[r:" + file.rel_type + "]->(b)";
+  } else {
+    var = "n";
+    query += "CREATE (n:" + file.from_label +
+             " {id: " + convert("id", type_of("id")) + "})";
+  }
+
+  bool first = true;
+  for (const Column &column : file.columns) {
+    if (column.name == "id" || column.name == "from_id" ||
+        column.name == "to_id")
+      continue;
+    query += first ? " SET " : ", ";
+    first = false;
+    query += var + ".`" + column.name +
+             "` = " + convert(column.name, column.type);
+  }
+  return query;
+}
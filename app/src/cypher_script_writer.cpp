@@ -0,0 +1,206 @@
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "../include/column_plan.hpp"
+#include "../include/cypher_script_writer.hpp"
+
+namespace {
+
+// Large enough that the script is written in big sequential blocks.
+constexpr size_t kBufferSize = 1 << 20;
+
+void append_string_literal(std::string &out, std::string_view value) {
+  out += '\'';
+  for (char c : value) {
+    switch (c) {
+    case '\'':
+      out += "\\'";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      out += c;
+    }
+  }
+  out += '\'';
+}
+
+// Templated because the map and list accessors of mgclient yield const views
+// rather than mg::Value itself.
+template <typename V> void append_literal(std::string &out, const V &value) {
+  switch (value.type()) {
+  case mg::Value::Type::Bool:
+    out += value.ValueBool() ? "true" : "false";
+    break;
+  case mg::Value::Type::Int:
+    out += std::to_string(value.ValueInt());
+    break;
+  case mg::Value::Type::Double: {
+    const double d = value.ValueDouble();
+    if (!std::isfinite(d)) {
+      out += "null";
+      break;
+    }
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.17g", d);
+    out += number;
+    // Keep the literal a float, e.g. '12.0' rather than '12'.
+    if (!std::strpbrk(number, ".e"))
+      out += ".0";
+    break;
+  }
+  case mg::Value::Type::String:
+    append_string_literal(out, value.ValueString());
+    break;
+  case mg::Value::Type::List: {
+    const auto &list = value.ValueList();
+    out += '[';
+    for (size_t i = 0; i < list.size(); ++i) {
+      if (i > 0)
+        out += ", ";
+      append_literal(out, list[i]);
+    }
+    out += ']';
+    break;
+  }
+  case mg::Value::Type::Map: {
+    out += '{';
+    bool first = true;
+    for (const auto &[key, item] : value.ValueMap()) {
+      if (!first)
+        out += ", ";
+      first = false;
+      out.append("`").append(key).append("`: ");
+      append_literal(out, item);
+    }
+    out += '}';
+    break;
+  }
+  case mg::Value::Type::Date:
+    out += "date('" + format_date(value.ValueDate().days()) + "')";
+    break;
+  case mg::Value::Type::LocalTime:
+    out += "localTime('" +
+           format_local_time(value.ValueLocalTime().nanoseconds()) + "')";
+    break;
+  case mg::Value::Type::LocalDateTime: {
+    const auto date_time = value.ValueLocalDateTime();
+    out += "localDateTime('" +
+           format_local_date_time(date_time.seconds(),
+                                  date_time.nanoseconds()) +
+           "')";
+    break;
+  }
+  default:
+    out += "null";
+  }
+}
+
+} // namespace
+
+/// <summary>
+/// Opens (and truncates) the script file. The client itself never connects.
+/// </summary>
+CypherScriptWriter::CypherScriptWriter(const std::string &path)
+    : MemgraphClient("", 0, true), buffer(kBufferSize) {
+  out.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+  out.open(path, std::ios::out | std::ios::trunc);
+  if (!out) {
+    throw std::runtime_error("Failed to open Cypher script " + path);
+  }
+}
+
+/// <summary>
+/// Appends the query, with its parameters inlined, as one statement.
+/// </summary>
+void CypherScriptWriter::ExecuteQuery(const std::string &query,
+                                      const mg::Map &params) {
+  Write(InlineParams(query, params));
+}
+
+/// <summary>
+/// Appends the query like ExecuteQuery() and reports an empty result.
+/// </summary>
+int64_t CypherScriptWriter::ExecuteCountQuery(const std::string &query,
+                                              const mg::Map &params) {
+  Write(InlineParams(query, params));
+  return 0;
+}
+
+/// <summary>
+/// Returns false, since nothing is executed while the script is written.
+/// </summary>
+bool CypherScriptWriter::ReportsCounts() const { return false; }
+
+/// <summary>
+/// Transactions are written as statements so the script keeps their
+/// boundaries.
+/// </summary>
+void CypherScriptWriter::BeginTransaction() { Write("BEGIN"); }
+
+void CypherScriptWriter::CommitTransaction() { Write("COMMIT"); }
+
+void CypherScriptWriter::RollbackTransaction() { Write("ROLLBACK"); }
+
+/// <summary>
+/// Returns the number of statements written so far.
+/// </summary>
+size_t CypherScriptWriter::StatementsWritten() const { return statements; }
+
+/// <summary>
+/// Replaces every '$name' in 'query' with the literal of that parameter.
+/// </summary>
+std::string CypherScriptWriter::InlineParams(const std::string &query,
+                                             const mg::Map &params) {
+  std::string result;
+  result.reserve(query.size() * 2);
+  size_t i = 0;
+  while (i < query.size()) {
+    if (query[i] != '$') {
+      result += query[i++];
+      continue;
+    }
+    size_t end = i + 1;
+    while (end < query.size() &&
+           (std::isalnum(static_cast<unsigned char>(query[end])) ||
+            query[end] == '_'))
+      ++end;
+    const std::string_view name(query.data() + i + 1, end - i - 1);
+    bool found = false;
+    for (const auto &[key, value] : params) {
+      if (key == name) {
+        append_literal(result, value);
+        found = true;
+        break;
+      }
+    }
+    if (!found)
+      result.append(query, i, end - i);
+    i = end;
+  }
+  return result;
+}
+
+/// <summary>
+/// Appends one statement terminated by ';'.
+/// </summary>
+void CypherScriptWriter::Write(const std::string &statement) {
+  out << statement << ";\n";
+  if (!out) {
+    throw std::runtime_error("Failed to write Cypher script.");
+  }
+  ++statements;
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 
 #include "../include/kafka_client.hpp"
@@ -8,17 +9,26 @@
 /// </summary>
 /// <param name="brokers">A string containing the comma-separated list of Kafka
 /// broker hostnames (e.g., "localhost:9092").</param> <param name="groupId">The
-/// consumer group ID that this client will be a part of.</param> <exception
-/// cref="std::runtime_error">Thrown if the RdKafka::KafkaConsumer fails to be
-/// created.</exception>
+/// consumer group ID that this client will be a part of.</param> <param
+/// name="resolver">Optional start offsets for assigned partitions.</param>
+/// <param name="on_revoke">Optional listener for revoked partitions.</param>
+/// <exception cref="std::runtime_error">Thrown if the RdKafka::KafkaConsumer
+/// fails to be created.</exception>
 KafkaClient::KafkaClient(const std::string &brokers,
-                         const std::string &groupId) {
+                         const std::string &groupId, OffsetResolver resolver,
+                         RevokeListener on_revoke) {
   std::string errstr;
   RdKafka::Conf *conf = RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL);
 
   conf->set("bootstrap.servers", brokers, errstr);
   conf->set("group.id", groupId, errstr);
   conf->set("auto.offset.reset", "earliest", errstr);
+  // Consumed records may wait in a queue before they are applied, so only
+  // offsets passed to StoreOffset() are auto-committed.
+  conf->set("enable.auto.offset.store", "false", errstr);
+  rebalance_handler = std::make_unique<RebalanceHandler>(
+      *this, std::move(resolver), std::move(on_revoke), paused_topics);
+  conf->set("rebalance_cb", rebalance_handler.get(), errstr);
 
   consumer = RdKafka::KafkaConsumer::create(conf, errstr);
   delete conf;
@@ -67,3 +77,120 @@ void KafkaClient::Subscribe(const std::vector<std::string> &topics) {
 RdKafka::Message *KafkaClient::Consume(int timeout_ms) {
   return consumer->consume(timeout_ms);
 }
+
+/// <summary>
+/// Stores the offset a partition resumes from for the next auto-commit.
+/// </summary>
+void KafkaClient::StoreOffset(const std::string &topic, int32_t partition,
+                              int64_t next_offset) {
+  std::vector<RdKafka::TopicPartition *> offsets = {
+      RdKafka::TopicPartition::create(topic, partition, next_offset)};
+  RdKafka::ErrorCode err = consumer->offsets_store(offsets);
+  RdKafka::TopicPartition::destroy(offsets);
+  // A partition revoked in the meantime is resumed from the offset its new
+  // owner stores.
+  if (err != RdKafka::ERR_NO_ERROR) {
+    std::cerr << "[WARNING] Could not store offset for " << topic << "["
+              << partition << "]: " << RdKafka::err2str(err) << std::endl;
+  }
+}
+
+/// <summary>
+/// Stops fetching the assigned partitions of the given topics.
+/// </summary>
+void KafkaClient::Pause(const std::vector<std::string> &topics) {
+  paused_topics.insert(topics.begin(), topics.end());
+  SetPaused(topics, true);
+}
+
+/// <summary>
+/// Resumes fetching the assigned partitions of the given topics.
+/// </summary>
+void KafkaClient::Resume(const std::vector<std::string> &topics) {
+  for (const std::string &topic : topics)
+    paused_topics.erase(topic);
+  SetPaused(topics, false);
+}
+
+/// <summary>
+/// Pauses or resumes the currently assigned partitions of 'topics'.
+/// Partitions assigned later are handled by the RebalanceHandler.
+/// </summary>
+void KafkaClient::SetPaused(const std::vector<std::string> &topics,
+                            bool pause) {
+  std::vector<RdKafka::TopicPartition *> assigned;
+  RdKafka::ErrorCode err = consumer->assignment(assigned);
+  if (err == RdKafka::ERR_NO_ERROR) {
+    std::vector<RdKafka::TopicPartition *> selected;
+    for (RdKafka::TopicPartition *partition : assigned) {
+      if (std::find(topics.begin(), topics.end(), partition->topic()) !=
+          topics.end())
+        selected.push_back(partition);
+    }
+    if (!selected.empty())
+      err = pause ? consumer->pause(selected) : consumer->resume(selected);
+  }
+  RdKafka::TopicPartition::destroy(assigned);
+  if (err != RdKafka::ERR_NO_ERROR) {
+    std::cerr << "[WARNING] Could not " << (pause ? "pause" : "resume")
+              << " topics: " << RdKafka::err2str(err) << std::endl;
+  }
+}
+
+/// <summary>
+/// Constructs a RebalanceHandler that resolves start offsets with 'resolver',
+/// if set, pauses newly assigned partitions of 'paused_topics' and passes
+/// revoked partitions to 'on_revoke', if set.
+/// </summary>
+KafkaClient::RebalanceHandler::RebalanceHandler(
+    KafkaClient &client, OffsetResolver resolver, RevokeListener on_revoke,
+    const std::set<std::string> &paused_topics)
+    : client(client), resolver(std::move(resolver)),
+      on_revoke(std::move(on_revoke)), paused_topics(paused_topics) {}
+
+/// <summary>
+/// Called by librdkafka from within Consume() when partitions are assigned or
+/// revoked. Assigned partitions start at the resolved offset, if any, and
+/// partitions of paused topics are paused again, since assignment resets it.
+/// Revoked partitions go to the listener first, since records consumed from
+/// them are consumed again by whichever consumer is assigned them next.
+/// </summary>
+void KafkaClient::RebalanceHandler::rebalance_cb(
+    RdKafka::KafkaConsumer *consumer, RdKafka::ErrorCode err,
+    std::vector<RdKafka::TopicPartition *> &partitions) {
+  if (err != RdKafka::ERR__ASSIGN_PARTITIONS) {
+    if (on_revoke) {
+      Partitions revoked;
+      for (RdKafka::TopicPartition *partition : partitions)
+        revoked.emplace_back(partition->topic(), partition->partition());
+      try {
+        on_revoke(client, revoked);
+      } catch (const std::exception &e) {
+        std::cerr << "[WARNING] Could not release revoked partitions: "
+                  << e.what() << std::endl;
+      }
+    }
+    consumer->unassign();
+    return;
+  }
+  std::vector<RdKafka::TopicPartition *> paused;
+  for (RdKafka::TopicPartition *partition : partitions) {
+    if (paused_topics.count(partition->topic()))
+      paused.push_back(partition);
+    if (!resolver)
+      continue;
+    try {
+      const int64_t offset =
+          resolver(partition->topic(), partition->partition());
+      if (offset >= 0)
+        partition->set_offset(offset);
+    } catch (const std::exception &e) {
+      std::cerr << "[WARNING] Could not resolve start offset for "
+                << partition->topic() << "[" << partition->partition()
+                << "]: " << e.what() << std::endl;
+    }
+  }
+  consumer->assign(partitions);
+  if (!paused.empty())
+    consumer->pause(paused);
+}
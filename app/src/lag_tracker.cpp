@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+
+#include "../external/json.hpp"
+#include "../include/lag_tracker.hpp"
+
+namespace {
+
+const char *const kStageNames[] = {"capture", "apply", "total"};
+
+} // namespace
+
+/// <summary>
+/// Constructs a LagTracker keeping the most recent 'window_size' samples per
+/// table and stage.
+/// </summary>
+LagTracker::LagTracker(size_t window_size)
+    : window_size(std::max<size_t>(window_size, 1)) {}
+
+/// <summary>
+/// Records one applied event into the table's rolling windows.
+/// </summary>
+void LagTracker::Record(const std::string &table, int64_t source_ts_ms,
+                        int64_t emit_ts_ms, int64_t applied_ts_ms) {
+  const int64_t values[] = {std::max<int64_t>(emit_ts_ms - source_ts_ms, 0),
+                            std::max<int64_t>(applied_ts_ms - emit_ts_ms, 0),
+                            std::max<int64_t>(applied_ts_ms - source_ts_ms, 0)};
+
+  std::lock_guard<std::mutex> lock(mutex);
+  TableLag &lag = tables[table];
+  for (int stage = 0; stage < 3; ++stage) {
+    lag.sums[stage] += values[stage];
+    if (lag.samples[stage].size() < window_size)
+      lag.samples[stage].push_back(values[stage]);
+    else
+      lag.samples[stage][lag.next] = values[stage];
+  }
+  lag.next = (lag.next + 1) % window_size;
+  ++lag.total;
+  lag.last_applied_ms = applied_ts_ms;
+}
+
+/// <summary>
+/// Computes percentiles over a copy of one stage's rolling window.
+/// </summary>
+LagSummary LagTracker::Summarize(const TableLag &lag, LagStage stage) {
+  std::vector<int64_t> sorted = lag.samples[static_cast<int>(stage)];
+  LagSummary summary;
+  summary.count = sorted.size();
+  if (sorted.empty())
+    return summary;
+
+  std::sort(sorted.begin(), sorted.end());
+  auto percentile = [&sorted](double q) {
+    size_t rank = static_cast<size_t>(std::ceil(q * sorted.size()));
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+  };
+  summary.p50 = percentile(0.50);
+  summary.p95 = percentile(0.95);
+  summary.p99 = percentile(0.99);
+  summary.max = sorted.back();
+  return summary;
+}
+
+/// <summary>
+/// Returns the percentiles for one table and stage.
+/// </summary>
+LagSummary LagTracker::Summary(const std::string &table,
+                               LagStage stage) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = tables.find(table);
+  if (it == tables.end())
+    return LagSummary();
+  return Summarize(it->second, stage);
+}
+
+/// <summary>
+/// Renders every table's lag percentiles as a JSON document.
+/// </summary>
+std::string LagTracker::ToJson() const {
+  nlohmann::json doc = nlohmann::json::object();
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto &[table, lag] : tables) {
+    nlohmann::json entry = {{"events", lag.total},
+                            {"last_applied_ms", lag.last_applied_ms}};
+    for (int stage = 0; stage < 3; ++stage) {
+      const LagSummary summary = Summarize(lag, static_cast<LagStage>(stage));
+      entry[kStageNames[stage]] = {{"p50_ms", summary.p50},
+                                   {"p95_ms", summary.p95},
+                                   {"p99_ms", summary.p99},
+                                   {"max_ms", summary.max}};
+    }
+    doc[table] = std::move(entry);
+  }
+  return doc.dump(2);
+}
+
+/// <summary>
+/// Renders every table's lag percentiles in the Prometheus text format. The
+/// quantiles cover the rolling window; '_sum' and '_count' cover every sample
+/// recorded, as Prometheus summaries expect.
+/// </summary>
+std::string LagTracker::ToPrometheus() const {
+  std::ostringstream out;
+  out << "# HELP memgraph_sync_lag_ms Replication lag per table and stage.\n"
+      << "# TYPE memgraph_sync_lag_ms summary\n";
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto &[table, lag] : tables) {
+    for (int stage = 0; stage < 3; ++stage) {
+      const LagSummary summary = Summarize(lag, static_cast<LagStage>(stage));
+      const std::string labels = "table=\"" + table + "\",stage=\"" +
+                                 kStageNames[stage] + "\"";
+      out << "memgraph_sync_lag_ms{" << labels << ",quantile=\"0.5\"} "
+          << summary.p50 << "\n"
+          << "memgraph_sync_lag_ms{" << labels << ",quantile=\"0.95\"} "
+          << summary.p95 << "\n"
+          << "memgraph_sync_lag_ms{" << labels << ",quantile=\"0.99\"} "
+          << summary.p99 << "\n"
+          << "memgraph_sync_lag_ms_sum{" << labels << "} " << lag.sums[stage]
+          << "\n"
+          << "memgraph_sync_lag_ms_count{" << labels << "} " << lag.total
+          << "\n";
+    }
+  }
+  return out.str();
+}
+
+/// <summary>
+/// Returns the current wall-clock time in milliseconds since the epoch.
+/// </summary>
+int64_t LagTracker::NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
@@ -1,10 +1,18 @@
 #include <csignal>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <vector>
 
+#include "../include/csv_bulk_loader.hpp"
 #include "../include/kafka_client.hpp"
+#include "../include/lag_tracker.hpp"
 #include "../include/memgraph_client.hpp"
 #include "../include/message_handler.hpp"
+#include "../include/priority_scheduler.hpp"
+#include "../include/status_server.hpp"
+#include "../include/tracer.hpp"
 
 /// <summary>
 /// A global, thread-safe flag to signal that the application should shut down
@@ -18,7 +26,63 @@ volatile sig_atomic_t shutdown_requested = 0;
 /// shutdown_requested flag.
 /// </summary>
 /// <param name="sig">The signal number that was caught.</param>
-void signal_handler(int sig) { shutdown_requested = 1; }
+void signal_handler(int) { shutdown_requested = 1; }
+
+/// <summary>
+/// Set by SIGUSR1 to have the main loop write the recorded trace to
+/// TRACE_FILE.
+/// </summary>
+volatile sig_atomic_t trace_dump_requested = 0;
+
+/// <summary>
+/// Signal handler for SIGUSR1. Sets the global trace_dump_requested flag.
+/// </summary>
+/// <param name="sig">The signal number that was caught.</param>
+void trace_signal_handler(int) { trace_dump_requested = 1; }
+
+/// <summary>
+/// Writes the recorded trace spans to a file as Chrome trace JSON.
+/// </summary>
+/// <param name="path">The file to (over)write.</param>
+void write_trace(const std::string &path) {
+  std::ofstream out(path, std::ios::out | std::ios::trunc);
+  out << Tracer::Instance().ToChromeJson();
+  if (!out) {
+    std::cerr << "\n[ERROR] Could not write trace to " << path << std::endl;
+    return;
+  }
+  std::cout << "[SUCCESS] Wrote trace to " << path << std::endl;
+}
+
+/// <summary>
+/// Reads an environment variable, falling back to a default when it is unset.
+/// </summary>
+/// <param name="name">The name of the environment variable.</param>
+/// <param name="def">The value to use when the variable is unset.</param>
+/// <returns>The variable's value or the default.</returns>
+std::string env_or_default(const char *name, const std::string &def) {
+  const char *value = std::getenv(name);
+  return value ? std::string(value) : def;
+}
+
+/// <summary>
+/// Priority lanes used unless PRIORITY_LANES overrides them: user-facing
+/// tables stay sub-second while the bulk tables backfill, and every other
+/// table shares the default lane.
+/// </summary>
+const char *const kDefaultLanes = R"([
+  {"name": "interactive", "tables": ["users", "businesses"], "weight": 8,
+   "batch_size": 50, "max_latency_ms": 500, "max_queued": 2000},
+  {"name": "default", "weight": 4, "batch_size": 200, "max_queued": 10000},
+  {"name": "bulk", "tables": ["notifications", "user_daily_activity_progress"],
+   "weight": 1, "batch_size": 500, "max_queued": 20000}
+])";
+
+/// <summary>
+/// The most messages taken from the consumer between two applied batches, so
+/// that applying keeps pace with a consumer that always has data ready.
+/// </summary>
+constexpr size_t kMaxPollsPerBatch = 1000;
 
 /// <summary>
 /// The main entry point for the Kafka-to-Memgraph synchronization service.
@@ -33,6 +97,7 @@ int main() {
   // Register signal handlers for graceful shutdown.
   signal(SIGINT, signal_handler);
   signal(SIGTERM, signal_handler);
+  signal(SIGUSR1, trace_signal_handler);
 
   // Initialize required third-party libraries.
   mg::Client::Init();
@@ -40,9 +105,97 @@ int main() {
   try {
     // 1. Initialize Clients
     // Establish connections to Kafka and Memgraph.
-    KafkaClient kafka("kafka:9092", "memgraph-sync-service");
     MemgraphClient memgraph("memgraph", 7687);
-    MessageHandler handler;
+
+    // Replication lag is tracked per table and served on the status port
+    // ('/lag' as JSON, '/metrics' for Prometheus). STATUS_PORT=0 disables it.
+    LagTracker lag_tracker;
+    MessageHandlerOptions options;
+    options.lag_tracker = &lag_tracker;
+    // Messages are applied in transactions that also store per-partition
+    // checkpoints, and assigned partitions resume from those checkpoints.
+    // CHECKPOINT_INTERVAL=0 disables this.
+    options.checkpoint_interval =
+        std::stoul(env_or_default("CHECKPOINT_INTERVAL", "100"));
+    options.checkpoints = options.checkpoint_interval > 0;
+    // Snapshot rows can be bulk loaded with LOAD CSV from a directory shared
+    // with Memgraph: SNAPSHOT_CSV_DIR here, SNAPSHOT_CSV_LOAD_DIR inside
+    // Memgraph if it differs. Unset keeps snapshots on Bolt.
+    std::unique_ptr<CsvBulkLoader> bulk_loader;
+    const std::string csv_dir = env_or_default("SNAPSHOT_CSV_DIR", "");
+    if (!csv_dir.empty()) {
+      CsvBulkLoaderOptions csv_options;
+      csv_options.directory = csv_dir;
+      csv_options.load_directory = env_or_default("SNAPSHOT_CSV_LOAD_DIR", "");
+      csv_options.rotate_rows =
+          std::stoul(env_or_default("SNAPSHOT_CSV_ROTATE_ROWS", "100000"));
+      csv_options.log_events = options.log_events;
+      bulk_loader = std::make_unique<CsvBulkLoader>(csv_options);
+      options.bulk_loader = bulk_loader.get();
+    }
+    MessageHandler handler(options);
+
+    // A sampled fraction of events is traced stage by stage (see Tracer):
+    // TRACE_SAMPLE_RATE=0.01 traces every 100th event per thread, and the
+    // last TRACE_BUFFER_SPANS spans per thread are kept. The trace is served
+    // on '/trace' and written to TRACE_FILE on SIGUSR1.
+    Tracer::Instance().Configure(
+        std::stod(env_or_default("TRACE_SAMPLE_RATE", "0")),
+        std::stoul(env_or_default("TRACE_BUFFER_SPANS", "65536")));
+    const std::string trace_file =
+        env_or_default("TRACE_FILE", "/tmp/memgraph-sync-trace.json");
+
+    // Topics are queued in priority lanes by table and applied in weighted
+    // fair order (see PriorityScheduler); PRIORITY_LANES takes a JSON array of
+    // lanes in place of kDefaultLanes.
+    PriorityScheduler scheduler(PriorityScheduler::LanesFromJson(
+        env_or_default("PRIORITY_LANES", kDefaultLanes)));
+
+    // Declared after the handler so that the consumer, which may still call
+    // the resolver and revoke listener while closing, is destroyed first.
+    KafkaClient::OffsetResolver resolver;
+    if (options.checkpoints)
+      resolver = [&](const std::string &topic, int32_t partition) {
+        return handler.ResumeOffset(topic, partition, memgraph);
+      };
+    // Kafka only commits the offsets of records committed in Memgraph, so
+    // that records still queued in a lane or buffered are consumed again
+    // after a crash.
+    auto store_offsets = [&handler](KafkaClient &client) {
+      for (const auto &[partition, offset] : handler.TakeCommittedOffsets())
+        client.StoreOffset(partition.first, partition.second, offset + 1);
+    };
+    // Revoked partitions are consumed again from their committed offsets, so
+    // their queued records are dropped rather than applied twice, and the
+    // records already applied are committed so that their offsets are too.
+    auto on_revoke = [&](KafkaClient &client,
+                         const KafkaClient::Partitions &partitions) {
+      scheduler.DropPartitions(partitions);
+      try {
+        handler.Flush(memgraph);
+      } catch (const std::runtime_error &e) {
+        std::cerr << "\n[ERROR] Could not flush buffered writes: " << e.what()
+                  << std::endl;
+      }
+      store_offsets(client);
+    };
+    KafkaClient kafka("kafka:9092", "memgraph-sync-service", resolver,
+                      on_revoke);
+
+    std::unique_ptr<StatusServer> status_server;
+    const int status_port = std::stoi(env_or_default("STATUS_PORT", "8080"));
+    if (status_port > 0) {
+      status_server = std::make_unique<StatusServer>(status_port);
+      status_server->Route("/lag", "application/json",
+                           [&lag_tracker] { return lag_tracker.ToJson(); });
+      status_server->Route("/metrics", "text/plain; version=0.0.4", [&] {
+        return lag_tracker.ToPrometheus() +
+               scheduler.ToPrometheus(LagTracker::NowMs());
+      });
+      status_server->Route("/trace", "application/json",
+                           [] { return Tracer::Instance().ToChromeJson(); });
+      status_server->Start();
+    }
 
     // 2. Subscribe to ALL Kafka Topics
     // The topics list corresponds to Debezium topics for tables in a relational
@@ -85,6 +238,16 @@ int main() {
         "tia_server.dev_tia_db.user_strengths",
         "tia_server.dev_tia_db.user_subscriptions",
         "tia_server.dev_tia_db.users"};
+    // Debezium heartbeats (enabled with 'heartbeat.interval.ms' on the
+    // connector) keep lag measurable while the tables are idle.
+    const std::string heartbeat_topic =
+        env_or_default("HEARTBEAT_TOPIC", "__debezium-heartbeat.tia_server");
+    if (!heartbeat_topic.empty())
+      topics.push_back(heartbeat_topic);
+    // Registers every topic with its lane up front, so that a lane can be
+    // paused before all of its topics have delivered.
+    for (const std::string &topic : topics)
+      scheduler.LaneFor(topic);
     kafka.Subscribe(topics);
 
     // 3. Run a quick test to ensure Memgraph is working and accessible.
@@ -94,32 +257,93 @@ int main() {
               << std::endl;
 
     // 4. Main Application Loop
-    // Continuously polls Kafka for new messages until a shutdown is requested.
+    // Alternates between draining the consumer into the lanes and applying one
+    // batch from the lane the scheduler picks, until a shutdown is requested.
     while (!shutdown_requested) {
-      // Consume a message with a 1-second timeout.
-      std::unique_ptr<RdKafka::Message> msg(kafka.Consume(1000));
+      if (trace_dump_requested) {
+        trace_dump_requested = 0;
+        write_trace(trace_file);
+      }
 
-      switch (msg->err()) {
-      case RdKafka::ERR_NO_ERROR:
-        // A valid message was received.
+      // Block for up to a second only when there is nothing left to apply.
+      int timeout_ms = scheduler.Queued() > 0 ? 0 : 1000;
+      bool idle = false;
+      for (size_t polls = 0; polls < kMaxPollsPerBatch; ++polls) {
+        std::unique_ptr<RdKafka::Message> msg(kafka.Consume(timeout_ms));
+        timeout_ms = 0;
+        if (msg->err() == RdKafka::ERR__TIMED_OUT) {
+          // No message ready. This is normal and expected.
+          idle = polls == 0 && scheduler.Queued() == 0;
+          break;
+        }
+        if (msg->err() != RdKafka::ERR_NO_ERROR) {
+          // An actual Kafka consumer error occurred.
+          std::cerr << "\n[WARNING] Consumer error: " << msg->errstr()
+                    << std::endl;
+          break;
+        }
+        QueuedRecord record;
+        record.topic = msg->topic_name();
+        record.partition = msg->partition();
+        record.offset = msg->offset();
+        if (msg->payload())
+          record.value.assign(static_cast<const char *>(msg->payload()),
+                              msg->len());
+        record.enqueued_ms = LagTracker::NowMs();
+        scheduler.Enqueue(std::move(record));
+      }
+
+      // Lanes that have run full stop fetching until they have drained.
+      for (const FlowChange &change : scheduler.UpdateFlowControl()) {
+        if (change.pause)
+          kafka.Pause(change.topics);
+        else
+          kafka.Resume(change.topics);
+      }
+
+      if (idle) {
+        // Use the idle time to write out buffered deletes and checkpoints.
+        try {
+          handler.Flush(memgraph);
+        } catch (const std::runtime_error &e) {
+          std::cerr << "\n[ERROR] Could not flush buffered writes: "
+                    << e.what() << std::endl;
+        }
+        store_offsets(kafka);
+        continue;
+      }
+
+      const int64_t now_ms = LagTracker::NowMs();
+      const std::vector<QueuedRecord> batch = scheduler.NextBatch(now_ms);
+      for (const QueuedRecord &record : batch) {
         try {
-          handler.Process(msg.get(), memgraph);
+          handler.ProcessRecord(record.value, record.topic, record.partition,
+                                record.offset, memgraph);
         } catch (const std::runtime_error &e) {
           std::cerr << "\n[ERROR] Could not process message: " << e.what()
                     << std::endl;
         }
-        break;
-      case RdKafka::ERR__TIMED_OUT:
-        // No message received within the timeout. This is normal and expected.
-        break;
-      default:
-        // An actual Kafka consumer error occurred.
-        std::cerr << "\n[WARNING] Consumer error: " << msg->errstr()
-                  << std::endl;
-        break;
       }
+      // A lane with a latency target commits at the end of each batch, so its
+      // writes become visible without waiting for the checkpoint interval.
+      if (!batch.empty() &&
+          scheduler.Config(scheduler.LaneFor(batch.front().topic))
+                  .max_latency_ms > 0) {
+        try {
+          handler.Flush(memgraph);
+        } catch (const std::runtime_error &e) {
+          std::cerr << "\n[ERROR] Could not flush buffered writes: "
+                    << e.what() << std::endl;
+        }
+      }
+      store_offsets(kafka);
     }
 
+    // Write out any deletes and checkpoints still buffered before the clients
+    // go away.
+    handler.Flush(memgraph);
+    store_offsets(kafka);
+
   } catch (const std::exception &e) {
     std::cerr << "A critical error occurred during setup: " << e.what()
               << std::endl;
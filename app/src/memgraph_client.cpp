@@ -1,15 +1,22 @@
 #include <iostream>
 
 #include "../include/memgraph_client.hpp"
+#include "../include/tracer.hpp"
 
 /// <summary>
 /// Constructs a MemgraphClient and establishes a connection to the database.
 /// </summary>
 /// <param name="host">The hostname or IP address of the Memgraph
 /// server.</param> <param name="port">The port on which the Memgraph server is
-/// running.</param> <exception cref="std::runtime_error">Thrown if the
-/// connection to Memgraph fails.</exception>
-MemgraphClient::MemgraphClient(const std::string &host, int port) {
+/// running.</param> <param name="dry_run">When true, no connection is opened
+/// and queries are discarded.</param> <exception
+/// cref="std::runtime_error">Thrown if the connection to Memgraph
+/// fails.</exception>
+MemgraphClient::MemgraphClient(const std::string &host, int port,
+                               bool dry_run) {
+  if (dry_run)
+    return;
+
   mg::Client::Params params;
   params.host = host;
   params.port = port;
@@ -33,13 +40,85 @@ MemgraphClient::MemgraphClient(const std::string &host, int port) {
 /// query execution fails.</exception>
 void MemgraphClient::ExecuteQuery(const std::string &query,
                                   const mg::Map &params) {
+  if (!client)
+    return;
+  // Execute() returns once the server has accepted the query, and
+  // DiscardAll() waits for it to finish, so they are traced apart.
+  TRACE_SPAN(execute_span, "execute", query);
   if (!client->Execute(query, params.AsConstMap())) {
     throw std::runtime_error("Failed to execute Memgraph query.");
   }
+  TRACE_END(execute_span);
   // Discard any potential results to clear the stream for the next query.
+  TRACE_SPAN(discard_span, "discard", query);
   client->DiscardAll();
 }
 
+/// <summary>
+/// Executes a Cypher query that returns a single integer and returns it.
+/// </summary>
+/// <param name="query">The Cypher query string to be executed.</param>
+/// <param name="params">A constant reference to a map of parameters to be used
+/// in the query.</param> <returns>The integer in the first column of the first
+/// row, or 0 if the query returned no rows.</returns> <exception
+/// cref="std::runtime_error">Thrown if the query execution fails.</exception>
+int64_t MemgraphClient::ExecuteCountQuery(const std::string &query,
+                                          const mg::Map &params) {
+  if (!client)
+    return 0;
+  TRACE_SPAN(execute_span, "execute", query);
+  if (!client->Execute(query, params.AsConstMap())) {
+    throw std::runtime_error("Failed to execute Memgraph query.");
+  }
+  auto rows = client->FetchAll();
+  if (!rows) {
+    throw std::runtime_error("Failed to fetch Memgraph query results.");
+  }
+  if (rows->empty() || (*rows)[0].empty())
+    return 0;
+  return (*rows)[0][0].ValueInt();
+}
+
+/// <summary>
+/// Begins an explicit transaction.
+/// </summary>
+/// <exception cref="std::runtime_error">Thrown if the transaction cannot be
+/// started.</exception>
+void MemgraphClient::BeginTransaction() {
+  if (!client)
+    return;
+  if (!client->BeginTransaction()) {
+    throw std::runtime_error("Failed to begin Memgraph transaction.");
+  }
+}
+
+/// <summary>
+/// Commits the open explicit transaction.
+/// </summary>
+/// <exception cref="std::runtime_error">Thrown if the commit
+/// fails.</exception>
+void MemgraphClient::CommitTransaction() {
+  if (!client)
+    return;
+  TRACE_SPAN(commit_span, "commit", "");
+  if (!client->CommitTransaction()) {
+    throw std::runtime_error("Failed to commit Memgraph transaction.");
+  }
+}
+
+/// <summary>
+/// Rolls back the open explicit transaction.
+/// </summary>
+/// <exception cref="std::runtime_error">Thrown if the rollback
+/// fails.</exception>
+void MemgraphClient::RollbackTransaction() {
+  if (!client)
+    return;
+  if (!client->RollbackTransaction()) {
+    throw std::runtime_error("Failed to roll back Memgraph transaction.");
+  }
+}
+
 /// <summary>
 /// Runs a simple hardcoded query to test the connection and write permissions.
 /// It attempts to create a single test node.
@@ -47,6 +126,8 @@ void MemgraphClient::ExecuteQuery(const std::string &query,
 /// <exception cref="std::runtime_error">Thrown if the test query fails to
 /// execute.</exception>
 void MemgraphClient::RunTestQuery() {
+  if (!client)
+    return;
   std::cout << "\n[TEST] Running a simple test query..." << std::endl;
   if (!client->Execute("CREATE (n:TestNode {property: 'hello world'})")) {
     throw std::runtime_error("Test query failed.");
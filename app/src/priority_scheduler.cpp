@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "../external/json.hpp"
+#include "../include/priority_scheduler.hpp"
+
+/// <summary>
+/// Constructs a scheduler with the given lanes. The first lane without tables
+/// becomes the default lane, or the last lane if every lane lists tables.
+/// </summary>
+PriorityScheduler::PriorityScheduler(std::vector<LaneConfig> configs) {
+  if (configs.empty()) {
+    throw std::runtime_error("PriorityScheduler needs at least one lane.");
+  }
+  default_lane = configs.size() - 1;
+  bool found_default = false;
+  for (size_t i = 0; i < configs.size(); ++i) {
+    const LaneConfig &config = configs[i];
+    if (!(config.weight > 0) || config.batch_size == 0) {
+      throw std::runtime_error("Lane '" + config.name +
+                               "' needs a positive weight and batch size.");
+    }
+    if (config.tables.empty() && !found_default) {
+      default_lane = i;
+      found_default = true;
+    }
+    for (const std::string &table : config.tables)
+      table_lanes.emplace(table, i);
+    Lane lane;
+    lane.config = config;
+    lanes.push_back(std::move(lane));
+  }
+}
+
+/// <summary>
+/// Parses lane configurations from a JSON array.
+/// </summary>
+std::vector<LaneConfig> PriorityScheduler::LanesFromJson(
+    const std::string &text) {
+  std::vector<LaneConfig> configs;
+  try {
+    const nlohmann::json doc = nlohmann::json::parse(text);
+    if (!doc.is_array()) {
+      throw std::runtime_error("expected an array of lanes");
+    }
+    for (const auto &entry : doc) {
+      LaneConfig config;
+      config.name = entry.at("name").get<std::string>();
+      config.tables = entry.value("tables", std::vector<std::string>());
+      config.weight = entry.value("weight", config.weight);
+      config.batch_size = entry.value("batch_size", config.batch_size);
+      config.max_latency_ms =
+          entry.value("max_latency_ms", config.max_latency_ms);
+      config.max_queued = entry.value("max_queued", config.max_queued);
+      configs.push_back(std::move(config));
+    }
+  } catch (const std::exception &e) {
+    throw std::runtime_error(std::string("Invalid lane configuration: ") +
+                             e.what());
+  }
+  return configs;
+}
+
+/// <summary>
+/// Returns the lane for a topic by the table name after its last '.'. The
+/// topic is remembered so that the lane's topics can be paused.
+/// </summary>
+size_t PriorityScheduler::LaneFor(const std::string &topic) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto known = topic_lanes.find(topic);
+  if (known != topic_lanes.end())
+    return known->second;
+
+  const size_t dot = topic.rfind('.');
+  const std::string table =
+      dot == std::string::npos ? topic : topic.substr(dot + 1);
+  auto it = table_lanes.find(table);
+  const size_t lane = it == table_lanes.end() ? default_lane : it->second;
+  topic_lanes.emplace(topic, lane);
+  lanes[lane].topics.push_back(topic);
+  return lane;
+}
+
+/// <summary>
+/// Returns the configuration of a lane. Configurations never change after
+/// construction, so no lock is needed.
+/// </summary>
+const LaneConfig &PriorityScheduler::Config(size_t lane) const {
+  return lanes.at(lane).config;
+}
+
+/// <summary>
+/// Queues a consumed record in its lane. A lane that was idle starts at the
+/// current virtual time, so idling earns it no credit.
+/// </summary>
+void PriorityScheduler::Enqueue(QueuedRecord record) {
+  const size_t index = LaneFor(record.topic);
+  std::lock_guard<std::mutex> lock(mutex);
+  Lane &lane = lanes[index];
+  if (lane.queue.empty())
+    lane.finish = std::max(lane.finish, virtual_time);
+  lane.queue.push_back(std::move(record));
+}
+
+/// <summary>
+/// Picks the lane that has missed its latency target by the largest factor,
+/// else the lane with the smallest virtual finish time, and removes up to its
+/// batch size of records from it.
+/// </summary>
+std::vector<QueuedRecord> PriorityScheduler::NextBatch(int64_t now_ms) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Lane *next = nullptr;
+  double most_overdue = 1;
+  for (Lane &lane : lanes) {
+    if (lane.queue.empty() || lane.config.max_latency_ms <= 0)
+      continue;
+    const double overdue =
+        static_cast<double>(now_ms - lane.queue.front().enqueued_ms) /
+        lane.config.max_latency_ms;
+    if (overdue > most_overdue) {
+      most_overdue = overdue;
+      next = &lane;
+    }
+  }
+  if (!next) {
+    for (Lane &lane : lanes) {
+      if (!lane.queue.empty() && (!next || lane.finish < next->finish))
+        next = &lane;
+    }
+  }
+
+  std::vector<QueuedRecord> batch;
+  if (!next)
+    return batch;
+  const size_t count = std::min(next->config.batch_size, next->queue.size());
+  batch.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    batch.push_back(std::move(next->queue.front()));
+    next->queue.pop_front();
+  }
+  virtual_time = std::max(virtual_time, next->finish);
+  next->finish += count / next->config.weight;
+  next->applied += count;
+  return batch;
+}
+
+/// <summary>
+/// Drops the queued records of the given partitions from every lane.
+/// </summary>
+size_t PriorityScheduler::DropPartitions(
+    const std::vector<std::pair<std::string, int32_t>> &partitions) {
+  auto revoked = [&partitions](const QueuedRecord &record) {
+    for (const auto &[topic, partition] : partitions)
+      if (record.partition == partition && record.topic == topic)
+        return true;
+    return false;
+  };
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t dropped = 0;
+  for (Lane &lane : lanes) {
+    const size_t queued = lane.queue.size();
+    lane.queue.erase(
+        std::remove_if(lane.queue.begin(), lane.queue.end(), revoked),
+        lane.queue.end());
+    dropped += queued - lane.queue.size();
+  }
+  return dropped;
+}
+
+/// <summary>
+/// Pauses a lane once its queue reaches 'max_queued' and resumes it once the
+/// queue has drained to half of that.
+/// </summary>
+std::vector<FlowChange> PriorityScheduler::UpdateFlowControl() {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<FlowChange> changes;
+  for (Lane &lane : lanes) {
+    if (lane.config.max_queued == 0)
+      continue;
+    const size_t queued = lane.queue.size();
+    if (!lane.paused && queued >= lane.config.max_queued) {
+      lane.paused = true;
+      changes.push_back({lane.topics, true});
+    } else if (lane.paused && queued <= lane.config.max_queued / 2) {
+      lane.paused = false;
+      changes.push_back({lane.topics, false});
+    }
+  }
+  return changes;
+}
+
+/// <summary>
+/// Returns the number of records queued in all lanes.
+/// </summary>
+size_t PriorityScheduler::Queued() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  size_t total = 0;
+  for (const Lane &lane : lanes)
+    total += lane.queue.size();
+  return total;
+}
+
+/// <summary>
+/// Returns the number of records queued in one lane.
+/// </summary>
+size_t PriorityScheduler::Queued(size_t lane) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return lane < lanes.size() ? lanes[lane].queue.size() : 0;
+}
+
+/// <summary>
+/// Renders per-lane queue length, applied count and head-of-line wait in the
+/// Prometheus text format.
+/// </summary>
+std::string PriorityScheduler::ToPrometheus(int64_t now_ms) const {
+  std::ostringstream out;
+  std::lock_guard<std::mutex> lock(mutex);
+  out << "# HELP memgraph_sync_lane_queued Records waiting per lane.\n"
+      << "# TYPE memgraph_sync_lane_queued gauge\n";
+  for (const Lane &lane : lanes)
+    out << "memgraph_sync_lane_queued{lane=\"" << lane.config.name << "\"} "
+        << lane.queue.size() << "\n";
+  out << "# HELP memgraph_sync_lane_applied Records applied per lane.\n"
+      << "# TYPE memgraph_sync_lane_applied counter\n";
+  for (const Lane &lane : lanes)
+    out << "memgraph_sync_lane_applied{lane=\"" << lane.config.name << "\"} "
+        << lane.applied << "\n";
+  out << "# HELP memgraph_sync_lane_wait_ms Age of the oldest queued record.\n"
+      << "# TYPE memgraph_sync_lane_wait_ms gauge\n";
+  for (const Lane &lane : lanes) {
+    const int64_t wait =
+        lane.queue.empty() ? 0 : now_ms - lane.queue.front().enqueued_ms;
+    out << "memgraph_sync_lane_wait_ms{lane=\"" << lane.config.name << "\"} "
+        << std::max<int64_t>(wait, 0) << "\n";
+  }
+  out << "# HELP memgraph_sync_lane_paused Whether a lane's topics are "
+         "paused.\n"
+      << "# TYPE memgraph_sync_lane_paused gauge\n";
+  for (const Lane &lane : lanes)
+    out << "memgraph_sync_lane_paused{lane=\"" << lane.config.name << "\"} "
+        << (lane.paused ? 1 : 0) << "\n";
+  return out.str();
+}
@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/csv_bulk_loader.hpp"
+#include "../include/cypher_script_writer.hpp"
+#include "../include/memgraph_client.hpp"
+#include "../include/message_handler.hpp"
+
+namespace {
+
+/// <summary>
+/// Command line options of sync-replay.
+/// </summary>
+struct ReplayOptions {
+  std::string input;
+  std::string format;
+  std::string writer = "null";
+  std::string out = "replay.cypherl";
+  std::string host = "localhost";
+  int port = 7687;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t chunk_size = 8192;
+  std::string csv_dir;
+  std::string csv_load_dir;
+  size_t csv_rotate_rows = 100000;
+};
+
+/// <summary>
+/// A read-only memory mapping of a whole file, unmapped on destruction.
+/// </summary>
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Failed to open " + path + ": " +
+                               std::strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+      close(fd);
+      throw std::runtime_error("Failed to stat " + path);
+    }
+    size = static_cast<size_t>(st.st_size);
+    if (size > 0) {
+      data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("Failed to mmap " + path);
+      }
+      madvise(data, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if (size > 0)
+      munmap(data, size);
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  std::string_view View() const {
+    return std::string_view(static_cast<const char *>(data), size);
+  }
+
+private:
+  void *data = nullptr;
+  size_t size = 0;
+};
+
+/// <summary>
+/// Splits a JSONL file into one record per non-empty line.
+/// </summary>
+std::vector<std::string_view> split_jsonl(std::string_view file) {
+  std::vector<std::string_view> records;
+  size_t start = 0;
+  while (start < file.size()) {
+    const void *newline =
+        std::memchr(file.data() + start, '\n', file.size() - start);
+    size_t end = newline ? static_cast<const char *>(newline) - file.data()
+                         : file.size();
+    std::string_view line = file.substr(start, end - start);
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    if (!line.empty())
+      records.push_back(line);
+    start = end + 1;
+  }
+  return records;
+}
+
+/// <summary>
+/// Splits a dump of records that are each prefixed with their length as a
+/// 4-byte big-endian integer, the framing Kafka itself uses. Zero-length
+/// records are tombstones and are kept so they are counted.
+/// </summary>
+std::vector<std::string_view> split_length_prefixed(std::string_view file) {
+  std::vector<std::string_view> records;
+  size_t pos = 0;
+  while (pos < file.size()) {
+    if (file.size() - pos < 4) {
+      throw std::runtime_error("Truncated length prefix at byte " +
+                               std::to_string(pos));
+    }
+    const auto *p = reinterpret_cast<const unsigned char *>(file.data() + pos);
+    const size_t len = (static_cast<size_t>(p[0]) << 24) |
+                       (static_cast<size_t>(p[1]) << 16) |
+                       (static_cast<size_t>(p[2]) << 8) | p[3];
+    pos += 4;
+    if (file.size() - pos < len) {
+      throw std::runtime_error("Truncated record at byte " +
+                               std::to_string(pos));
+    }
+    records.push_back(file.substr(pos, len));
+    pos += len;
+  }
+  return records;
+}
+
+/// <summary>
+/// Parses records[begin, end) on 'threads' threads. Malformed records and
+/// tombstones come back as discarded values.
+/// </summary>
+std::vector<json> parse_chunk(const std::vector<std::string_view> &records,
+                              size_t begin, size_t end, unsigned threads) {
+  std::vector<json> parsed(end - begin);
+  auto parse_range = [&](size_t from, size_t to) {
+    for (size_t i = from; i < to; ++i) {
+      parsed[i - begin] =
+          records[i].empty()
+              ? json(json::value_t::discarded)
+              : json::parse(records[i], nullptr, /*allow_exceptions=*/false);
+    }
+  };
+
+  const size_t per_thread = (end - begin + threads - 1) / threads;
+  std::vector<std::thread> workers;
+  for (size_t from = begin + per_thread; from < end; from += per_thread)
+    workers.emplace_back(parse_range, from, std::min(end, from + per_thread));
+  parse_range(begin, std::min(end, begin + per_thread));
+  for (auto &worker : workers)
+    worker.join();
+  return parsed;
+}
+
+void print_usage() {
+  std::cerr
+      << "Usage: sync-replay [options] <file>\n"
+      << "Replays Debezium envelopes from a file through the mapping layer.\n\n"
+      << "  --format jsonl|dump  Input format. Defaults to 'jsonl' for\n"
+      << "                       *.jsonl files and to 'dump' (records\n"
+      << "                       prefixed with a 4-byte big-endian length)\n"
+      << "                       otherwise.\n"
+      << "  --writer null|script|memgraph\n"
+      << "                       Where writes go (default: null).\n"
+      << "  --out <path>         Script path for --writer script.\n"
+      << "  --host <host>        Memgraph host for --writer memgraph.\n"
+      << "  --port <port>        Memgraph port for --writer memgraph.\n"
+      << "  --threads <n>        Parser threads (default: all cores).\n"
+      << "  --chunk <n>          Events parsed per chunk (default: 8192).\n"
+      << "  --csv-dir <dir>      Stage snapshot rows as CSV files in <dir>\n"
+      << "                       and load them with LOAD CSV through the\n"
+      << "                       writer.\n"
+      << "  --csv-load-dir <dir> The CSV directory as Memgraph sees it.\n"
+      << "  --csv-rotate <n>     Load a CSV file once it has <n> rows\n"
+      << "                       (default: 100000, 0 = only at the end).\n";
+}
+
+/// <summary>
+/// Parses the command line. Returns false if it is invalid.
+/// </summary>
+bool parse_args(int argc, char **argv, ReplayOptions &options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    auto value = [&]() -> std::string {
+      if (i + 1 >= argc)
+        throw std::invalid_argument(arg + " needs a value");
+      return argv[++i];
+    };
+    if (arg == "--format")
+      options.format = value();
+    else if (arg == "--writer")
+      options.writer = value();
+    else if (arg == "--out")
+      options.out = value();
+    else if (arg == "--host")
+      options.host = value();
+    else if (arg == "--port")
+      options.port = std::stoi(value());
+    else if (arg == "--threads")
+      options.threads = std::max(1, std::stoi(value()));
+    else if (arg == "--chunk")
+      options.chunk_size = std::max(1, std::stoi(value()));
+    else if (arg == "--csv-dir")
+      options.csv_dir = value();
+    else if (arg == "--csv-load-dir")
+      options.csv_load_dir = value();
+    else if (arg == "--csv-rotate")
+      options.csv_rotate_rows = std::stoul(value());
+    else if (arg == "--help" || arg == "-h")
+      return false;
+    else if (!arg.empty() && arg[0] == '-')
+      throw std::invalid_argument("Unknown option " + arg);
+    else
+      options.input = arg;
+  }
+  if (options.format.empty()) {
+    const std::string suffix = ".jsonl";
+    const bool jsonl =
+        options.input.size() >= suffix.size() &&
+        options.input.compare(options.input.size() - suffix.size(),
+                              suffix.size(), suffix) == 0;
+    options.format = jsonl ? "jsonl" : "dump";
+  }
+  return !options.input.empty() &&
+         (options.format == "jsonl" || options.format == "dump") &&
+         (options.writer == "null" || options.writer == "script" ||
+          options.writer == "memgraph");
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+} // namespace
+
+/// <summary>
+/// Entry point of sync-replay, an offline tool that pushes Debezium envelopes
+/// from a local file through the same MessageHandler the service uses and
+/// reports throughput. It never connects to Kafka. Records are parsed in
+/// parallel, one chunk ahead of the single thread that applies them in file
+/// order, so the tool measures the ceiling of the mapping layer and can
+/// rebuild a graph from an archived topic.
+/// </summary>
+/// <returns>0 on success, 1 on a fatal error and 2 on invalid
+/// arguments.</returns>
+int main(int argc, char **argv) {
+  ReplayOptions options;
+  try {
+    if (!parse_args(argc, argv, options)) {
+      print_usage();
+      return 2;
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    print_usage();
+    return 2;
+  }
+
+  mg::Client::Init();
+  try {
+    std::unique_ptr<MemgraphClient> writer;
+    CypherScriptWriter *script = nullptr;
+    if (options.writer == "script") {
+      auto script_writer = std::make_unique<CypherScriptWriter>(options.out);
+      script = script_writer.get();
+      writer = std::move(script_writer);
+    } else if (options.writer == "memgraph") {
+      writer = std::make_unique<MemgraphClient>(options.host, options.port);
+    } else {
+      writer = std::make_unique<MemgraphClient>("", 0, true);
+    }
+
+    MessageHandlerOptions handler_options;
+    handler_options.log_events = false;
+    std::unique_ptr<CsvBulkLoader> bulk_loader;
+    if (!options.csv_dir.empty()) {
+      CsvBulkLoaderOptions csv_options;
+      csv_options.directory = options.csv_dir;
+      csv_options.load_directory = options.csv_load_dir;
+      csv_options.rotate_rows = options.csv_rotate_rows;
+      csv_options.log_events = handler_options.log_events;
+      bulk_loader = std::make_unique<CsvBulkLoader>(csv_options);
+      handler_options.bulk_loader = bulk_loader.get();
+    }
+    MessageHandler handler(handler_options);
+
+    const auto start = std::chrono::steady_clock::now();
+    MappedFile file(options.input);
+    const std::vector<std::string_view> records =
+        options.format == "jsonl" ? split_jsonl(file.View())
+                                  : split_length_prefixed(file.View());
+    const double split_seconds = seconds_since(start);
+
+    size_t written = 0, skipped = 0, malformed = 0, failed = 0;
+    double apply_seconds = 0;
+    auto parse_next = [&](size_t begin) {
+      const size_t end = std::min(records.size(), begin + options.chunk_size);
+      return std::async(std::launch::async, parse_chunk, std::cref(records),
+                        begin, end, options.threads);
+    };
+
+    std::future<std::vector<json>> next;
+    if (!records.empty())
+      next = parse_next(0);
+    for (size_t begin = 0; begin < records.size();
+         begin += options.chunk_size) {
+      std::vector<json> chunk = next.get();
+      if (begin + options.chunk_size < records.size())
+        next = parse_next(begin + options.chunk_size);
+
+      const auto apply_start = std::chrono::steady_clock::now();
+      for (const json &event : chunk) {
+        if (event.is_discarded()) {
+          ++malformed;
+          continue;
+        }
+        try {
+          if (handler.ProcessParsedEvent(event, *writer))
+            ++written;
+          else
+            ++skipped;
+        } catch (const std::exception &e) {
+          ++failed;
+          std::cerr << "[ERROR] Could not apply event: " << e.what()
+                    << std::endl;
+        }
+      }
+      apply_seconds += seconds_since(apply_start);
+    }
+    const auto flush_start = std::chrono::steady_clock::now();
+    handler.Flush(*writer);
+    apply_seconds += seconds_since(flush_start);
+    const double total_seconds = seconds_since(start);
+
+    size_t bytes = 0;
+    for (const auto &record : records)
+      bytes += record.size();
+    const double mib = bytes / (1024.0 * 1024.0);
+    std::cout << "Replayed " << records.size() << " events (" << mib
+              << " MiB) in " << total_seconds << " s: "
+              << records.size() / std::max(total_seconds, 1e-9)
+              << " events/s, " << mib / std::max(total_seconds, 1e-9)
+              << " MiB/s\n"
+              << "  written: " << written << ", skipped: " << skipped
+              << ", malformed or tombstone: " << malformed
+              << ", failed: " << failed << "\n"
+              << "  split: " << split_seconds << " s, apply: " << apply_seconds
+              << " s (" << written / std::max(apply_seconds, 1e-9)
+              << " writes/s), parser threads: " << options.threads
+              << std::endl;
+    if (script)
+      std::cout << "  statements written to " << options.out << ": "
+                << script->StatementsWritten() << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "Replay failed: " << e.what() << std::endl;
+    mg::Client::Finalize();
+    return 1;
+  }
+  mg::Client::Finalize();
+  return 0;
+}
@@ -0,0 +1,147 @@
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "../include/status_server.hpp"
+
+/// <summary>
+/// Constructs a StatusServer that will listen on the given TCP port.
+/// </summary>
+StatusServer::StatusServer(int port) : port(port) {}
+
+/// <summary>
+/// Destructor. Stops the server thread if it is still running.
+/// </summary>
+StatusServer::~StatusServer() { Stop(); }
+
+/// <summary>
+/// Registers a handler for a path.
+/// </summary>
+void StatusServer::Route(const std::string &path,
+                         const std::string &content_type, Handler handler) {
+  endpoints[path] = Endpoint{content_type, std::move(handler)};
+}
+
+/// <summary>
+/// Binds the listening socket and starts serving on a background thread.
+/// </summary>
+/// <exception cref="std::runtime_error">Thrown if the socket cannot be created
+/// or bound.</exception>
+void StatusServer::Start() {
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    throw std::runtime_error("Failed to create status server socket.");
+  }
+  int reuse = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(static_cast<uint16_t>(port));
+  if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(listen_fd, 16) < 0) {
+    close(listen_fd);
+    listen_fd = -1;
+    throw std::runtime_error("Failed to bind status server to port " +
+                             std::to_string(port));
+  }
+
+  running = true;
+  thread = std::thread(&StatusServer::Run, this);
+  std::cout << "Status server listening on port " << port << std::endl;
+}
+
+/// <summary>
+/// Stops serving and joins the background thread.
+/// </summary>
+void StatusServer::Stop() {
+  running = false;
+  if (thread.joinable())
+    thread.join();
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    listen_fd = -1;
+  }
+}
+
+/// <summary>
+/// The accept loop. Polls with a short timeout so that Stop() is noticed
+/// promptly.
+/// </summary>
+void StatusServer::Run() {
+  while (running) {
+    pollfd pfd{listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, 200) <= 0)
+      continue;
+    int client_fd = accept(listen_fd, nullptr, nullptr);
+    if (client_fd < 0)
+      continue;
+    HandleClient(client_fd);
+    close(client_fd);
+  }
+}
+
+/// <summary>
+/// Reads one request from a connected client and writes the response.
+/// </summary>
+void StatusServer::HandleClient(int client_fd) {
+  // A stalled client must not block the server thread.
+  timeval timeout{1, 0};
+  setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.size() < 8192) {
+    ssize_t n = recv(client_fd, buffer, sizeof(buffer), 0);
+    if (n <= 0)
+      break;
+    request.append(buffer, static_cast<size_t>(n));
+  }
+
+  // Request line: "GET /path?query HTTP/1.1".
+  std::string status = "404 Not Found";
+  std::string content_type = "text/plain";
+  std::string body = "Not Found\n";
+  const size_t method_end = request.find(' ');
+  const size_t path_end = request.find_first_of(" ?", method_end + 1);
+  if (method_end != std::string::npos && path_end != std::string::npos) {
+    const std::string method = request.substr(0, method_end);
+    const std::string path =
+        request.substr(method_end + 1, path_end - method_end - 1);
+    auto it = endpoints.find(path);
+    if (method != "GET") {
+      status = "405 Method Not Allowed";
+      body = "Method Not Allowed\n";
+    } else if (it != endpoints.end()) {
+      try {
+        body = it->second.handler();
+        status = "200 OK";
+        content_type = it->second.content_type;
+      } catch (const std::exception &e) {
+        status = "500 Internal Server Error";
+        body = std::string(e.what()) + "\n";
+      }
+    }
+  }
+
+  const std::string response =
+      "HTTP/1.1 " + status + "\r\nContent-Type: " + content_type +
+      "\r\nContent-Length: " + std::to_string(body.size()) +
+      "\r\nConnection: close\r\n\r\n" + body;
+  size_t sent = 0;
+  while (sent < response.size()) {
+    ssize_t n = send(client_fd, response.data() + sent, response.size() - sent,
+                     MSG_NOSIGNAL);
+    if (n <= 0)
+      break;
+    sent += static_cast<size_t>(n);
+  }
+}
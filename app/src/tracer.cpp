@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <unordered_map>
+
+#include "../external/json.hpp"
+#include "../include/tracer.hpp"
+
+namespace {
+
+// Distinct details kept per thread; later ones are recorded without detail.
+constexpr size_t kMaxDetails = 4096;
+
+thread_local bool thread_sampled = false;
+thread_local uint64_t thread_events = 0;
+
+/// <summary>
+/// One recorded span. 'detail' indexes the owning buffer's interned details.
+/// </summary>
+struct Span {
+  const char *name = nullptr;
+  uint32_t detail = 0;
+  int64_t start_ns = 0;
+  int64_t duration_ns = 0;
+};
+
+} // namespace
+
+/// <summary>
+/// The ring buffer of one thread. Only that thread writes to it, and the
+/// lock is uncontended except while a trace is being rendered.
+/// </summary>
+struct Tracer::Buffer {
+  std::mutex mutex;
+  uint32_t thread_id = 0;
+  std::vector<Span> spans;
+  size_t next = 0;
+  bool wrapped = false;
+  std::vector<std::string> details;
+  // Detail ids by hash; colliding details share a hash and are told apart by
+  // their text.
+  std::unordered_multimap<size_t, uint32_t> detail_ids;
+
+  void Reset(size_t capacity) {
+    spans.assign(capacity, Span());
+    next = 0;
+    wrapped = false;
+    details.assign(1, std::string());
+    detail_ids.clear();
+  }
+};
+
+/// <summary>
+/// Returns the process-wide tracer.
+/// </summary>
+Tracer &Tracer::Instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+/// <summary>
+/// Sets the sampling rate as an interval of 1/rate events and resizes every
+/// thread's ring buffer.
+/// </summary>
+void Tracer::Configure(double sample_rate, size_t spans) {
+  sample_interval = sample_rate > 0
+                        ? std::max<uint64_t>(std::llround(1 / sample_rate), 1)
+                        : 0;
+  buffer_spans = spans;
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto &buffer : buffers) {
+    std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+    buffer->Reset(spans);
+  }
+}
+
+/// <summary>
+/// Counts one event on the calling thread; every Nth is sampled.
+/// </summary>
+bool Tracer::ShouldSample() {
+  const uint64_t interval = sample_interval.load(std::memory_order_relaxed);
+  return interval > 0 && ++thread_events % interval == 0;
+}
+
+/// <summary>
+/// Records a finished span into the calling thread's ring buffer.
+/// </summary>
+void Tracer::Record(const char *name, std::string_view detail,
+                    int64_t start_ns, int64_t duration_ns) {
+  Buffer &buffer = ThreadBuffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  if (buffer.spans.empty())
+    return;
+
+  uint32_t detail_id = 0;
+  if (!detail.empty()) {
+    const size_t hash = std::hash<std::string_view>()(detail);
+    auto [it, end] = buffer.detail_ids.equal_range(hash);
+    while (it != end && buffer.details[it->second] != detail)
+      ++it;
+    if (it != end) {
+      detail_id = it->second;
+    } else if (buffer.details.size() < kMaxDetails) {
+      detail_id = static_cast<uint32_t>(buffer.details.size());
+      buffer.details.emplace_back(detail);
+      buffer.detail_ids.emplace(hash, detail_id);
+    }
+  }
+
+  buffer.spans[buffer.next] = {name, detail_id, start_ns, duration_ns};
+  if (++buffer.next == buffer.spans.size()) {
+    buffer.next = 0;
+    buffer.wrapped = true;
+  }
+}
+
+/// <summary>
+/// Renders the spans of all threads, oldest first, as complete ('X') events
+/// with microsecond timestamps. Each span's detail is its 'detail' argument.
+/// </summary>
+std::string Tracer::ToChromeJson() const {
+  nlohmann::json events = nlohmann::json::array();
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto &buffer : buffers) {
+    std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+    events.push_back(
+        {{"name", "thread_name"},
+         {"ph", "M"},
+         {"pid", 1},
+         {"tid", buffer->thread_id},
+         {"args", {{"name", "thread-" + std::to_string(buffer->thread_id)}}}});
+    const size_t count = buffer->wrapped ? buffer->spans.size() : buffer->next;
+    const size_t first = buffer->wrapped ? buffer->next : 0;
+    for (size_t i = 0; i < count; ++i) {
+      const Span &span = buffer->spans[(first + i) % buffer->spans.size()];
+      nlohmann::json event = {{"name", span.name},
+                              {"cat", "sync"},
+                              {"ph", "X"},
+                              {"pid", 1},
+                              {"tid", buffer->thread_id},
+                              {"ts", span.start_ns / 1000.0},
+                              {"dur", span.duration_ns / 1000.0}};
+      if (span.detail > 0)
+        event["args"] = {{"detail", buffer->details[span.detail]}};
+      events.push_back(std::move(event));
+    }
+  }
+  nlohmann::json doc = {{"traceEvents", std::move(events)},
+                        {"displayTimeUnit", "ms"}};
+  return doc.dump();
+}
+
+/// <summary>
+/// Returns whether the calling thread is inside a sampled event.
+/// </summary>
+bool Tracer::Sampled() { return thread_sampled; }
+
+/// <summary>
+/// Marks the calling thread as inside a sampled event or not.
+/// </summary>
+void Tracer::SetSampled(bool sampled) { thread_sampled = sampled; }
+
+/// <summary>
+/// Returns a monotonic timestamp in nanoseconds.
+/// </summary>
+int64_t Tracer::NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+/// <summary>
+/// Returns the calling thread's buffer. The tracer shares ownership, so the
+/// spans of a finished thread can still be rendered.
+/// </summary>
+Tracer::Buffer &Tracer::ThreadBuffer() {
+  thread_local std::shared_ptr<Buffer> buffer;
+  if (!buffer) {
+    buffer = std::make_shared<Buffer>();
+    buffer->Reset(buffer_spans);
+    std::lock_guard<std::mutex> lock(mutex);
+    buffer->thread_id = static_cast<uint32_t>(buffers.size() + 1);
+    buffers.push_back(buffer);
+  }
+  return *buffer;
+}
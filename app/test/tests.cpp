@@ -1,8 +1,18 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <string>
+#include <vector>
 
 #include "../external/doctest/doctest.h"
+#include "../include/csv_bulk_loader.hpp"
+#include "../include/cypher_script_writer.hpp"
 #include "../include/message_handler.hpp"
+#include "../include/priority_scheduler.hpp"
+#include "../include/tracer.hpp"
 
 // --- Tests for Helper Functions ---
 
@@ -43,18 +53,86 @@ public:
 
   // Override the ExecuteQuery method to capture the query and params.
   void ExecuteQuery(const std::string &query, const mg::Map &params) override {
+    MaybeFail(query);
     last_query = query;
-    // In a real test, you would inspect the params map as well.
+    queries.push_back(query);
+    last_prop_keys.clear();
+    last_params.clear();
+    for (const auto &[key, value] : params) {
+      last_params.emplace_back(key, value);
+      if (key == "props" && value.type() == mg::Value::Type::Map) {
+        for (const auto &[prop_key, prop_value] : value.ValueMap())
+          last_prop_keys.emplace_back(prop_key);
+      }
+    }
   }
 
+  // Records count queries and answers them with 'count_result'.
+  int64_t ExecuteCountQuery(const std::string &query,
+                            const mg::Map &) override {
+    queries.push_back(query);
+    return count_result;
+  }
+
+  bool ReportsCounts() const override { return reports_counts; }
+
+  // Transactions are recorded as pseudo-queries.
+  void BeginTransaction() override { queries.push_back("BEGIN"); }
+  void CommitTransaction() override {
+    MaybeFail("COMMIT");
+    queries.push_back("COMMIT");
+  }
+  void RollbackTransaction() override { queries.push_back("ROLLBACK"); }
+
   std::string last_query;
+  std::vector<std::string> queries;
+  // When non-empty, a query (or "COMMIT") containing this fragment throws
+  // 'fail_times' times.
+  std::string fail_on;
+  int fail_times = 1;
+
+  void MaybeFail(const std::string &query) {
+    if (fail_on.empty() || query.find(fail_on) == std::string::npos)
+      return;
+    if (--fail_times <= 0)
+      fail_on.clear();
+    throw std::runtime_error("Failed to execute Memgraph query.");
+  }
+  std::vector<std::string> last_prop_keys;
+  std::vector<std::pair<std::string, mg::Value>> last_params;
+  int64_t count_result = 0;
+  bool reports_counts = true;
+
+  // Returns a parameter of the last query, looking into 'props' too.
+  const mg::Value *param(const std::string &name) const {
+    for (const auto &[key, value] : last_params) {
+      if (key == name)
+        return &value;
+      if (key == "props" && value.type() == mg::Value::Type::Map) {
+        for (const auto &[prop_key, prop_value] : value.ValueMap())
+          if (prop_key == name)
+            return &prop_value;
+      }
+    }
+    return nullptr;
+  }
 };
 
+// Returns true if any recorded query contains the given fragment.
+bool any_query_contains(const MockMemgraphClient &client,
+                        const std::string &fragment) {
+  return std::any_of(client.queries.begin(), client.queries.end(),
+                     [&](const std::string &query) {
+                       return query.find(fragment) != std::string::npos;
+                     });
+}
+
 // --- Tests for MessageHandler::Process ---
 
 TEST_CASE("MessageHandler correctly processes Debezium messages") {
   MessageHandler handler;
   MockMemgraphClient mock_client;
+  QueryCache query_cache;
 
   SUBCASE("Processes a simple 'users' create message") {
     // 1. Create a fake Kafka message with a Debezium JSON payload.
@@ -73,7 +151,8 @@ TEST_CASE("MessageHandler correctly processes Debezium messages") {
 
     // Let's test the logic by creating a query manually and comparing.
     const json data = json::parse(user_payload)["payload"]["after"];
-    map_node(data, 'c', "User", mock_client);
+    MappingContext ctx{mock_client, query_cache};
+    map_node(data, 'c', "User", ctx);
 
     // 2. Check if the correct Cypher query was generated.
     std::string expected_query = "MERGE (n:User {id: $id}) SET n += $props";
@@ -82,11 +161,1187 @@ TEST_CASE("MessageHandler correctly processes Debezium messages") {
 
   SUBCASE("Processes a 'user_skills' relationship create message") {
     const json data = {{"user_id", 101}, {"skill_id", 202}};
+    MappingContext ctx{mock_client, query_cache};
     map_relationship(data, 'c', "User", "Skill", "HAS_SKILL", "user_id",
-                     "skill_id", mock_client);
+                     "skill_id", ctx);
 
     std::string expected_query = "MATCH (a:User {id: $from_id}) MATCH (b:Skill "
                                  "{id: $to_id}) MERGE (a)-[:HAS_SKILL]->(b)";
     CHECK(mock_client.last_query == expected_query);
   }
 }
+
+// --- Tests for update-diff mode ---
+
+TEST_CASE("Update events only write what changed") {
+  MessageHandler handler;
+  MockMemgraphClient mock_client;
+
+  SUBCASE("Only changed columns are sent as props") {
+    CHECK(handler.ProcessEvent(R"({"payload": {"op": "u",
+        "before": {"id": 7, "name": "Acme", "updated_at": 1},
+        "after": {"id": 7, "name": "Acme", "updated_at": 2},
+        "source": {"table": "regions"}}})",
+                               mock_client));
+    CHECK(mock_client.queries.size() == 1);
+    CHECK(mock_client.last_prop_keys ==
+          std::vector<std::string>{"updated_at"});
+  }
+
+  SUBCASE("Unchanged FK columns do not re-MERGE relationships") {
+    handler.ProcessEvent(R"({"payload": {"op": "u",
+        "before": {"id": 3, "name": "Old", "business_type_id": 4},
+        "after": {"id": 3, "name": "New", "business_type_id": 4},
+        "source": {"table": "businesses"}}})",
+                         mock_client);
+    CHECK(mock_client.queries.size() == 1);
+    CHECK_FALSE(any_query_contains(mock_client, "IS_TYPE"));
+  }
+
+  SUBCASE("Changed FK columns re-MERGE relationships") {
+    handler.ProcessEvent(R"({"payload": {"op": "u",
+        "before": {"id": 3, "business_type_id": 4},
+        "after": {"id": 3, "business_type_id": 5},
+        "source": {"table": "businesses"}}})",
+                         mock_client);
+    CHECK(any_query_contains(mock_client, "IS_TYPE"));
+  }
+
+  SUBCASE("Events without a graph-relevant change are skipped") {
+    CHECK_FALSE(handler.ProcessEvent(R"({"payload": {"op": "u",
+        "before": {"user_id": 1, "skill_id": 2, "created_at": 1},
+        "after": {"user_id": 1, "skill_id": 2, "created_at": 2},
+        "source": {"table": "user_skills"}}})",
+                                     mock_client));
+    CHECK(mock_client.queries.empty());
+  }
+
+  SUBCASE("Updates without a before image write the full row") {
+    MessageHandlerOptions options;
+    options.diff_updates = false;
+    MessageHandler full_handler(options);
+    full_handler.ProcessEvent(R"({"payload": {"op": "u",
+        "before": {"id": 7, "name": "Acme"},
+        "after": {"id": 7, "name": "Acme"},
+        "source": {"table": "regions"}}})",
+                              mock_client);
+    CHECK(mock_client.last_prop_keys.size() == 2);
+  }
+}
+
+// --- Tests for functional FK relationships ---
+
+TEST_CASE("Changed FK columns replace the old relationship") {
+  struct FkCase {
+    std::string table;
+    std::string fk_col;
+    std::string rel_type;
+  };
+  const std::vector<FkCase> cases = {
+      {"projects", "managed_by_user_id", "MANAGES"},
+      {"businesses", "operator_user_id", "OPERATES"},
+      {"businesses", "business_type_id", "IS_TYPE"},
+      {"businesses", "business_category_id", "IN_CATEGORY"},
+      {"businesses", "business_phase_id", "IN_PHASE"},
+      {"skills", "category_id", "IN_CATEGORY"},
+      {"strengths", "category_id", "IN_CATEGORY"},
+      {"industries", "category_id", "IN_CATEGORY"},
+      {"ideas", "submitted_by_user_id", "SUBMITTED"},
+      {"user_posts", "poster_user_id", "CREATED"},
+      {"case_studies", "owner_user_id", "OWNS"},
+      {"notifications", "sender_user_id", "SENT"},
+      {"notifications", "receiver_user_id", "RECEIVED_BY"},
+      {"business_connections", "initiating_business_id",
+       "INITIATED_CONNECTION"},
+      {"business_connections", "receiving_business_id", "RECEIVED_BY"},
+      {"business_connections", "connection_type_id", "HAS_TYPE"},
+  };
+
+  // Returns the recorded queries that touch the given relationship type.
+  auto rel_queries = [](const MockMemgraphClient &client,
+                        const std::string &rel_type) {
+    std::vector<std::string> matching;
+    for (const auto &query : client.queries)
+      if (query.find(":" + rel_type + "]") != std::string::npos)
+        matching.push_back(query);
+    return matching;
+  };
+
+  for (const auto &c : cases) {
+    CAPTURE(c.table);
+    CAPTURE(c.fk_col);
+    MessageHandler handler;
+
+    json event = {{"payload",
+                   {{"op", "u"},
+                    {"before", {{"id", 1}, {c.fk_col, 10}}},
+                    {"after", {{"id", 1}, {c.fk_col, 20}}},
+                    {"source", {{"table", c.table}}}}}};
+
+    // FK changed: one query deletes the old edge and merges the new one.
+    MockMemgraphClient changed_client;
+    handler.ProcessEvent(event.dump(), changed_client);
+    auto queries = rel_queries(changed_client, c.rel_type);
+    REQUIRE(queries.size() == 1);
+    CHECK(queries[0].find("[old:" + c.rel_type + "]") != std::string::npos);
+    CHECK(queries[0].find("DELETE old") != std::string::npos);
+    CHECK(queries[0].find("MERGE") != std::string::npos);
+
+    // FK set to null: the old edge is only deleted.
+    MockMemgraphClient cleared_client;
+    json cleared = event;
+    cleared["payload"]["after"][c.fk_col] = nullptr;
+    handler.ProcessEvent(cleared.dump(), cleared_client);
+    queries = rel_queries(cleared_client, c.rel_type);
+    REQUIRE(queries.size() == 1);
+    CHECK(queries[0].find("DELETE old") != std::string::npos);
+    CHECK(queries[0].find("MERGE") == std::string::npos);
+
+    // FK unchanged: no relationship query.
+    MockMemgraphClient unchanged_client;
+    json unchanged = event;
+    unchanged["payload"]["after"][c.fk_col] = 10;
+    unchanged["payload"]["after"]["name"] = "renamed";
+    handler.ProcessEvent(unchanged.dump(), unchanged_client);
+    CHECK(rel_queries(unchanged_client, c.rel_type).empty());
+
+    // Create: the row may already exist, so its old edge is replaced too.
+    MockMemgraphClient created_client;
+    json created = event;
+    created["payload"]["op"] = "c";
+    created["payload"]["before"] = nullptr;
+    handler.ProcessEvent(created.dump(), created_client);
+    queries = rel_queries(created_client, c.rel_type);
+    REQUIRE(queries.size() == 1);
+    CHECK(queries[0].find("DELETE old") != std::string::npos);
+    CHECK(queries[0].find("MERGE") != std::string::npos);
+
+    // Re-snapshot into a populated label: a key changed while the service
+    // was not syncing replaces the old edge.
+    json snapshot = created;
+    snapshot["payload"]["op"] = "r";
+    snapshot["payload"]["source"]["snapshot"] = "true";
+    MockMemgraphClient populated_client;
+    populated_client.count_result = 1;
+    MessageHandler resnapshot_handler;
+    resnapshot_handler.ProcessEvent(snapshot.dump(), populated_client);
+    queries = rel_queries(populated_client, c.rel_type);
+    REQUIRE(queries.size() == 1);
+    CHECK(queries[0].find("DELETE old") != std::string::npos);
+
+    // Append-only snapshot into an empty label: the edge is only merged.
+    MockMemgraphClient empty_client;
+    MessageHandler snapshot_handler;
+    snapshot_handler.ProcessEvent(snapshot.dump(), empty_client);
+    queries = rel_queries(empty_client, c.rel_type);
+    REQUIRE(queries.size() == 1);
+    CHECK(queries[0].find("DELETE") == std::string::npos);
+    CHECK(queries[0].find("MERGE") != std::string::npos);
+  }
+}
+
+// --- Tests for batched deletes ---
+
+TEST_CASE("Deletes are buffered and executed in batches") {
+  MockMemgraphClient mock_client;
+
+  auto delete_event = [](const std::string &table, const json &before) {
+    json event = {{"payload",
+                   {{"op", "d"},
+                    {"before", before},
+                    {"after", nullptr},
+                    {"source", {{"table", table}}}}}};
+    return event.dump();
+  };
+
+  SUBCASE("Node deletes are sent as one UNWIND per label") {
+    MessageHandler handler;
+    for (int id = 1; id <= 5; ++id)
+      handler.ProcessEvent(delete_event("notifications", {{"id", id}}),
+                           mock_client);
+    CHECK(mock_client.queries.empty());
+
+    handler.Flush(mock_client);
+    REQUIRE(mock_client.queries.size() == 1);
+    CHECK(mock_client.queries[0] == "UNWIND $ids AS id MATCH (n:Notification "
+                                    "{id: id}) DETACH DELETE n");
+  }
+
+  SUBCASE("Offsets of buffered deletes are released once flushed") {
+    MessageHandler handler;
+    handler.ProcessRecord(
+        json({{"payload",
+               {{"op", "c"},
+                {"after", {{"id", 1}, {"first_name", "A"}}},
+                {"source", {{"table", "users"}}}}}})
+            .dump(),
+        "users", 0, 10, mock_client);
+    CHECK(handler.TakeCommittedOffsets().at({"users", 0}) == 10);
+    handler.ProcessRecord(delete_event("users", {{"id", 1}}), "users", 0, 11,
+                          mock_client);
+    CHECK(handler.TakeCommittedOffsets().empty());
+
+    handler.Flush(mock_client);
+    CHECK(handler.TakeCommittedOffsets().at({"users", 0}) == 11);
+  }
+
+  SUBCASE("Batches are limited to delete_batch_size") {
+    MessageHandlerOptions options;
+    options.delete_batch_size = 2;
+    MessageHandler handler(options);
+    for (int id = 1; id <= 5; ++id)
+      handler.ProcessEvent(delete_event("regions", {{"id", id}}), mock_client);
+    CHECK(mock_client.queries.size() == 2);
+    handler.Flush(mock_client);
+    CHECK(mock_client.queries.size() == 3);
+  }
+
+  SUBCASE("Join-table deletes for a deleted parent are dropped") {
+    MessageHandler handler;
+    handler.ProcessEvent(
+        delete_event("user_skills", {{"user_id", 1}, {"skill_id", 10}}),
+        mock_client);
+    handler.ProcessEvent(delete_event("users", {{"id", 1}}), mock_client);
+    handler.ProcessEvent(
+        delete_event("user_skills", {{"user_id", 1}, {"skill_id", 11}}),
+        mock_client);
+    handler.ProcessEvent(
+        delete_event("user_skills", {{"user_id", 2}, {"skill_id", 10}}),
+        mock_client);
+
+    handler.Flush(mock_client);
+    REQUIRE(mock_client.queries.size() == 2);
+    CHECK(any_query_contains(mock_client, "DETACH DELETE n"));
+    CHECK(any_query_contains(mock_client, "[r:HAS_SKILL]"));
+  }
+
+  SUBCASE("Join-table deletes under a guarded parent delete are kept") {
+    MessageHandler handler;
+    auto guarded = [&](const std::string &table, const json &before) {
+      json event = json::parse(delete_event(table, before));
+      event["payload"]["source"]["lsn"] = 100;
+      return event.dump();
+    };
+    handler.ProcessEvent(
+        guarded("user_skills", {{"user_id", 1}, {"skill_id", 10}}),
+        mock_client);
+    handler.ProcessEvent(guarded("users", {{"id", 1}}), mock_client);
+
+    handler.Flush(mock_client);
+    REQUIRE(mock_client.queries.size() == 2);
+    CHECK(any_query_contains(mock_client, "DETACH DELETE n"));
+    CHECK(any_query_contains(mock_client, "[r:HAS_SKILL]"));
+  }
+
+  SUBCASE("A failed batch stays buffered for the next flush") {
+    MessageHandler handler;
+    handler.ProcessEvent(delete_event("users", {{"id", 1}}), mock_client);
+    handler.ProcessEvent(delete_event("users", {{"id", 2}}), mock_client);
+    mock_client.fail_on = "DETACH DELETE";
+    CHECK_THROWS_AS(handler.Flush(mock_client), std::runtime_error);
+    CHECK(mock_client.queries.empty());
+
+    handler.Flush(mock_client);
+    REQUIRE(mock_client.queries.size() == 1);
+    const mg::Value *ids = mock_client.param("ids");
+    REQUIRE(ids != nullptr);
+    CHECK(ids->ValueList().size() == 2);
+  }
+
+  SUBCASE("A failed flush does not lose the event that triggered it") {
+    MessageHandler handler;
+    handler.ProcessEvent(delete_event("users", {{"id", 1}}), mock_client);
+    mock_client.fail_on = "DETACH DELETE";
+    CHECK(handler.ProcessEvent(R"({"payload": {"op": "c",
+        "after": {"id": 2, "first_name": "B"},
+        "source": {"table": "users"}}})",
+                               mock_client));
+    REQUIRE(mock_client.queries.size() == 1);
+    CHECK(mock_client.queries[0].find("MERGE") != std::string::npos);
+
+    handler.Flush(mock_client);
+    REQUIRE(mock_client.queries.size() == 2);
+    CHECK(mock_client.queries[1].find("DETACH DELETE") != std::string::npos);
+  }
+
+  SUBCASE("Pending deletes are flushed before any other write") {
+    MessageHandler handler;
+    handler.ProcessEvent(delete_event("users", {{"id", 1}}), mock_client);
+    handler.ProcessEvent(R"({"payload": {"op": "c",
+        "after": {"id": 1, "first_name": "Again"},
+        "source": {"table": "users"}}})",
+                         mock_client);
+    REQUIRE(mock_client.queries.size() == 2);
+    CHECK(mock_client.queries[0].find("DETACH DELETE") != std::string::npos);
+    CHECK(mock_client.queries[1].find("MERGE") != std::string::npos);
+  }
+
+  SUBCASE("A batch size of 1 deletes immediately") {
+    MessageHandlerOptions options;
+    options.delete_batch_size = 1;
+    MessageHandler handler(options);
+    handler.ProcessEvent(delete_event("users", {{"id", 1}}), mock_client);
+    REQUIRE(mock_client.queries.size() == 1);
+    CHECK(mock_client.queries[0] ==
+          "MATCH (n:User {id: $id}) DETACH DELETE n");
+  }
+}
+
+// --- Tests for non-row events, truncates and snapshots ---
+
+TEST_CASE("Every Debezium op type is handled without throwing") {
+  MessageHandler handler;
+  MockMemgraphClient mock_client;
+
+  SUBCASE("Events without a row op are ignored") {
+    // A schema change event as published by Debezium.
+    CHECK_FALSE(handler.ProcessEvent(
+        R"({"payload": {"databaseName": "dev_tia_db",
+            "ddl": "ALTER TABLE users ADD COLUMN bio TEXT",
+            "source": {"table": "users"}}})",
+        mock_client));
+    CHECK_FALSE(handler.ProcessEvent(R"({"payload": null})", mock_client));
+    CHECK_FALSE(handler.ProcessEvent(R"({"payload": {"op": "m",
+        "source": {"table": "users"}}})",
+                                     mock_client));
+    CHECK_FALSE(handler.ProcessEvent(R"({"payload": {"op": "u",
+        "after": {"id": 1}}})",
+                                     mock_client));
+    CHECK(mock_client.queries.empty());
+  }
+
+  SUBCASE("Truncating a node table clears its label in batches") {
+    CHECK(handler.ProcessEvent(R"({"payload": {"op": "t",
+        "before": null, "after": null,
+        "source": {"table": "notifications"}}})",
+                               mock_client));
+    REQUIRE(mock_client.queries.size() == 1);
+    CHECK(mock_client.queries[0] ==
+          "MATCH (n:Notification) WITH n LIMIT $limit DETACH DELETE n "
+          "RETURN count(*)");
+  }
+
+  SUBCASE("Truncates are unbounded when counts are not reported") {
+    mock_client.reports_counts = false;
+    CHECK(handler.ProcessEvent(R"({"payload": {"op": "t",
+        "before": null, "after": null,
+        "source": {"table": "notifications"}}})",
+                               mock_client));
+    REQUIRE(mock_client.queries.size() == 1);
+    CHECK(mock_client.queries[0] == "MATCH (n:Notification) DETACH DELETE n");
+  }
+
+  SUBCASE("Truncating a join table clears its relationship type") {
+    CHECK(handler.ProcessEvent(R"({"payload": {"op": "t",
+        "before": null, "after": null,
+        "source": {"table": "user_skills"}}})",
+                               mock_client));
+    REQUIRE(mock_client.queries.size() == 1);
+    CHECK(mock_client.queries[0] ==
+          "MATCH (:User)-[r:HAS_SKILL]->(:Skill) WITH r LIMIT $limit DELETE "
+          "r RETURN count(*)");
+  }
+
+  SUBCASE("Snapshot reads into an empty label use CREATE") {
+    const std::string snapshot_event = R"({"payload": {"op": "r",
+        "after": {"id": 1, "name": "North"},
+        "source": {"table": "regions", "snapshot": "true"}}})";
+    handler.ProcessEvent(snapshot_event, mock_client);
+    handler.ProcessEvent(snapshot_event, mock_client);
+    REQUIRE(mock_client.queries.size() == 3);
+    CHECK(mock_client.queries[0].find("LIMIT 1") != std::string::npos);
+    CHECK(mock_client.queries[1] ==
+          "CREATE (n:Region {id: $id}) SET n += $props");
+    CHECK(mock_client.queries[2] == mock_client.queries[1]);
+  }
+
+  SUBCASE("Snapshot reads into a populated label use MERGE") {
+    mock_client.count_result = 1;
+    handler.ProcessEvent(R"({"payload": {"op": "r",
+        "after": {"id": 1, "name": "North"},
+        "source": {"table": "regions", "snapshot": "true"}}})",
+                         mock_client);
+    CHECK(mock_client.last_query ==
+          "MERGE (n:Region {id: $id}) SET n += $props");
+  }
+
+  SUBCASE("A later snapshot run checks the label again") {
+    auto region = [](const std::string &marker) {
+      const json source = {{"table", "regions"}, {"snapshot", marker}};
+      return json({{"payload",
+                    {{"op", "r"},
+                     {"after", {{"id", 1}, {"name", "North"}}},
+                     {"source", source}}}})
+          .dump();
+    };
+    handler.ProcessEvent(region("first"), mock_client);
+    handler.ProcessEvent(region("last"), mock_client);
+    CHECK(mock_client.last_query ==
+          "CREATE (n:Region {id: $id}) SET n += $props");
+
+    // The label is populated by now, so a re-snapshot must MERGE.
+    mock_client.count_result = 1;
+    handler.ProcessEvent(region("first"), mock_client);
+    CHECK(mock_client.last_query ==
+          "MERGE (n:Region {id: $id}) SET n += $props");
+    REQUIRE(mock_client.queries.size() == 5);
+    CHECK(mock_client.queries[3].find("LIMIT 1") != std::string::npos);
+  }
+
+  SUBCASE("Incremental snapshots always use MERGE") {
+    handler.ProcessEvent(R"({"payload": {"op": "r",
+        "after": {"id": 1, "name": "North"},
+        "source": {"table": "regions", "snapshot": "incremental"}}})",
+                         mock_client);
+    REQUIRE(mock_client.queries.size() == 1);
+    CHECK(mock_client.last_query ==
+          "MERGE (n:Region {id: $id}) SET n += $props");
+  }
+}
+
+// --- Tests for replication lag tracking ---
+
+TEST_CASE("LagTracker keeps rolling percentiles per table") {
+  LagTracker tracker(100);
+  for (int64_t i = 1; i <= 200; ++i)
+    tracker.Record("users", 0, i, i);
+
+  // Only the most recent 100 samples (101..200) remain in the window.
+  const LagSummary capture = tracker.Summary("users", LagStage::Capture);
+  CHECK(capture.count == 100);
+  CHECK(capture.p50 == 150);
+  CHECK(capture.p99 == 199);
+  CHECK(capture.max == 200);
+  CHECK(tracker.Summary("users", LagStage::Apply).max == 0);
+  CHECK(tracker.Summary("projects", LagStage::Total).count == 0);
+
+  // Clock skew never produces negative lag.
+  tracker.Record("regions", 1000, 900, 800);
+  CHECK(tracker.Summary("regions", LagStage::Total).max == 0);
+
+  CHECK(json::parse(tracker.ToJson())["users"]["capture"]["p50_ms"] == 150);
+  CHECK(tracker.ToPrometheus().find(
+            "memgraph_sync_lag_ms{table=\"users\",stage=\"capture\","
+            "quantile=\"0.5\"} 150") != std::string::npos);
+  CHECK(tracker.ToPrometheus().find(
+            "memgraph_sync_lag_ms_sum{table=\"regions\",stage=\"capture\"} "
+            "0") != std::string::npos);
+}
+
+TEST_CASE("MessageHandler records lag from Debezium timestamps") {
+  LagTracker tracker;
+  MessageHandlerOptions options;
+  options.lag_tracker = &tracker;
+  MessageHandler handler(options);
+  MockMemgraphClient mock_client;
+
+  const int64_t now = LagTracker::NowMs();
+  json event = {{"payload",
+                 {{"op", "c"},
+                  {"after", {{"id", 1}}},
+                  {"ts_ms", now - 1000},
+                  {"source", {{"table", "users"}, {"ts_ms", now - 3000}}}}}};
+  handler.ProcessEvent(event.dump(), mock_client);
+
+  const LagSummary capture = tracker.Summary("users", LagStage::Capture);
+  CHECK(capture.count == 1);
+  CHECK(capture.max == 2000);
+  CHECK(tracker.Summary("users", LagStage::Total).max >= 3000);
+
+  SUBCASE("Heartbeats are recorded without touching the graph") {
+    json heartbeat = {{"payload", {{"ts_ms", now - 500}}}};
+    CHECK_FALSE(handler.ProcessEvent(heartbeat.dump(), mock_client));
+    CHECK(tracker.Summary("__heartbeat", LagStage::Total).max >= 500);
+    CHECK(mock_client.queries.size() == 1);
+  }
+
+  SUBCASE("Events are recorded once their writes are committed") {
+    json delete_event = event;
+    delete_event["payload"]["op"] = "d";
+    delete_event["payload"]["before"] = {{"id", 1}};
+    handler.ProcessEvent(delete_event.dump(), mock_client);
+    CHECK(tracker.Summary("users", LagStage::Total).count == 1);
+    handler.Flush(mock_client);
+    CHECK(tracker.Summary("users", LagStage::Total).count == 2);
+
+    MessageHandlerOptions checkpointed = options;
+    checkpointed.checkpoints = true;
+    MessageHandler transactional(checkpointed);
+    transactional.ProcessRecord(event.dump(), "users", 0, 1, mock_client);
+    CHECK(tracker.Summary("users", LagStage::Total).count == 2);
+    transactional.Flush(mock_client);
+    CHECK(tracker.Summary("users", LagStage::Total).count == 3);
+  }
+}
+
+// --- Tests for idempotent replay and checkpoints ---
+
+TEST_CASE("Source positions are totally ordered") {
+  const int64_t first = source_position(
+      {{"file", "mysql-bin.000003"}, {"pos", 900}, {"row", 0}});
+  CHECK(first > 0);
+  CHECK(source_position(
+            {{"file", "mysql-bin.000003"}, {"pos", 900}, {"row", 1}}) > first);
+  CHECK(source_position(
+            {{"file", "mysql-bin.000003"}, {"pos", 1200}, {"row", 0}}) > first);
+  CHECK(source_position({{"file", "mysql-bin.000004"}, {"pos", 4}}) > first);
+  CHECK(source_position({{"lsn", 24023128}}) == 24023128);
+  CHECK(source_position({{"table", "users"}}) == 0);
+}
+
+TEST_CASE("Writes only apply when they are newer than the graph") {
+  MockMemgraphClient mock_client;
+  MessageHandler handler;
+  const json source = {
+      {"table", "users"}, {"file", "mysql-bin.000001"}, {"pos", 400}};
+
+  SUBCASE("Upserts are guarded and stamp the position") {
+    handler.ProcessEvent(json({{"payload",
+                                {{"op", "c"},
+                                 {"after", {{"id", 1}, {"first_name", "A"}}},
+                                 {"source", source}}}})
+                             .dump(),
+                         mock_client);
+    CHECK(mock_client.last_query ==
+          "MERGE (n:User {id: $id}) WITH n WHERE coalesce(n._src_pos, -1) <= "
+          "$src_pos SET n += $props, n._src_pos = $src_pos");
+  }
+
+  SUBCASE("Batched deletes carry a position per row") {
+    handler.ProcessEvent(json({{"payload",
+                                {{"op", "d"},
+                                 {"before", {{"id", 1}}},
+                                 {"source", source}}}})
+                             .dump(),
+                         mock_client);
+    handler.Flush(mock_client);
+    REQUIRE(mock_client.queries.size() == 1);
+    CHECK(mock_client.queries[0] ==
+          "UNWIND $rows AS row MATCH (n:User {id: row.id}) WHERE "
+          "coalesce(n._src_pos, -1) <= row.src_pos DETACH DELETE n");
+  }
+
+  SUBCASE("Relationship MERGEs are guarded on the edge") {
+    json skill_source = source;
+    skill_source["table"] = "user_skills";
+    handler.ProcessEvent(json({{"payload",
+                                {{"op", "c"},
+                                 {"after", {{"user_id", 1}, {"skill_id", 2}}},
+                                 {"source", skill_source}}}})
+                             .dump(),
+                         mock_client);
+    CHECK(mock_client.last_query ==
+          "MATCH (a:User {id: $from_id}) MATCH (b:Skill {id: $to_id}) MERGE "
+          "(a)-[r:HAS_SKILL]->(b) WITH r WHERE coalesce(r._src_pos, -1) <= "
+          "$src_pos SET r._src_pos = $src_pos");
+  }
+}
+
+TEST_CASE("Checkpoints commit in the same transaction as the data") {
+  MockMemgraphClient mock_client;
+  MessageHandlerOptions options;
+  options.checkpoints = true;
+  options.checkpoint_interval = 2;
+  MessageHandler handler(options);
+
+  auto user = [](int id) {
+    return json({{"payload",
+                  {{"op", "c"},
+                   {"after", {{"id", id}, {"first_name", "A"}}},
+                   {"source", {{"table", "users"}}}}}})
+        .dump();
+  };
+
+  SUBCASE("Every checkpoint_interval messages are committed together") {
+    handler.ProcessRecord(user(1), "users", 0, 10, mock_client);
+    handler.ProcessRecord("", "users", 0, 11, mock_client);
+    CHECK(handler.ResumeOffset("users", 0, mock_client) == 12);
+    handler.ProcessRecord(user(2), "users", 0, 12, mock_client);
+    REQUIRE(mock_client.queries.size() == 5);
+    CHECK(mock_client.queries[0] == "BEGIN");
+    CHECK(mock_client.queries[3].find("MERGE (k:SyncCheckpoint") !=
+          std::string::npos);
+    CHECK(mock_client.queries[4] == "COMMIT");
+
+    // Nothing is open now, so the offset comes from Memgraph.
+    mock_client.count_result = 13;
+    CHECK(handler.ResumeOffset("users", 0, mock_client) == 13);
+    mock_client.count_result = 0;
+    CHECK(handler.ResumeOffset("users", 1, mock_client) == -1);
+  }
+
+  SUBCASE("Offsets are released for Kafka once their transaction commits") {
+    handler.ProcessRecord(user(1), "users", 0, 10, mock_client);
+    CHECK(handler.TakeCommittedOffsets().empty());
+    handler.ProcessRecord(user(2), "users", 0, 11, mock_client);
+    const MessageHandler::PartitionOffsets offsets =
+        handler.TakeCommittedOffsets();
+    REQUIRE(offsets.size() == 1);
+    CHECK(offsets.at({"users", 0}) == 11);
+    CHECK(handler.TakeCommittedOffsets().empty());
+  }
+
+  SUBCASE("A failed message rolls back and re-applies the rest") {
+    const std::string region = R"({"payload": {"op": "c",
+        "after": {"id": 1, "name": "North"},
+        "source": {"table": "regions"}}})";
+    handler.ProcessRecord(user(1), "users", 0, 10, mock_client);
+    mock_client.fail_on = "MERGE (n:Region";
+    mock_client.fail_times = 2;
+    CHECK_THROWS_AS(
+        handler.ProcessRecord(region, "regions", 0, 11, mock_client),
+        std::runtime_error);
+    REQUIRE(mock_client.queries.size() == 8);
+    CHECK(mock_client.queries[2] == "ROLLBACK");
+    CHECK(mock_client.queries[3] == "BEGIN");
+    CHECK(mock_client.queries[4].find("MERGE (n:User") != std::string::npos);
+    CHECK(mock_client.queries[5] == "ROLLBACK");
+
+    handler.Flush(mock_client);
+    CHECK(mock_client.queries.back() == "COMMIT");
+  }
+
+  SUBCASE("A failed commit keeps its messages for the next one") {
+    handler.ProcessRecord(user(1), "users", 0, 10, mock_client);
+    mock_client.fail_on = "COMMIT";
+    CHECK_THROWS_AS(
+        handler.ProcessRecord(user(2), "users", 0, 11, mock_client),
+        std::runtime_error);
+    CHECK(handler.ResumeOffset("users", 0, mock_client) == 12);
+    mock_client.queries.clear();
+
+    handler.Flush(mock_client);
+    REQUIRE(mock_client.queries.size() == 2);
+    CHECK(mock_client.queries[1] == "COMMIT");
+    const mg::Value *checkpoints = mock_client.param("checkpoints");
+    REQUIRE(checkpoints != nullptr);
+    REQUIRE(checkpoints->ValueList().size() == 1);
+    for (const auto &[key, value] : checkpoints->ValueList()[0].ValueMap())
+      if (key == "offset")
+        CHECK(value.ValueInt() == 11);
+  }
+
+  SUBCASE("A message that failed once is retried after the recovery") {
+    handler.ProcessRecord(user(1), "users", 0, 10, mock_client);
+    mock_client.fail_on = "MERGE (n:User";
+    handler.ProcessRecord(user(2), "users", 0, 11, mock_client);
+    REQUIRE(mock_client.queries.size() == 8);
+    CHECK(mock_client.queries[2] == "ROLLBACK");
+    CHECK(mock_client.queries[5].find("MERGE (n:User") != std::string::npos);
+    CHECK(mock_client.queries.back() == "COMMIT");
+  }
+}
+
+// --- Tests for the Cypher script writer ---
+
+TEST_CASE("CypherScriptWriter inlines parameters as Cypher literals") {
+  mg::Map props(3);
+  props.Insert("name", mg::Value("O'Brien"));
+  props.Insert("score", mg::Value(12.0));
+  props.Insert("active", mg::Value(true));
+  mg::List ids(2);
+  ids.Append(mg::Value(1));
+  ids.Append(mg::Value("a"));
+  mg::Map params(3);
+  params.Insert("id", mg::Value(7));
+  params.Insert("props", mg::Value(std::move(props)));
+  params.Insert("ids", mg::Value(std::move(ids)));
+
+  CHECK(CypherScriptWriter::InlineParams(
+            "MERGE (n:User {id: $id}) SET n += $props", params) ==
+        "MERGE (n:User {id: 7}) SET n += {`name`: 'O\\'Brien', `score`: "
+        "12.0, `active`: true}");
+  CHECK(CypherScriptWriter::InlineParams("UNWIND $ids AS id RETURN $missing",
+                                         params) ==
+        "UNWIND [1, 'a'] AS id RETURN $missing");
+}
+
+// --- Tests for the CSV bulk loader ---
+
+// A unique directory under the system temp directory, removed with its
+// contents on destruction.
+struct TempDirectory {
+  TempDirectory() {
+    std::string pattern =
+        (std::filesystem::temp_directory_path() / "memgraph-sync-XXXXXX")
+            .string();
+    if (!mkdtemp(pattern.data()))
+      throw std::runtime_error("Failed to create a temp directory.");
+    path = pattern;
+  }
+  ~TempDirectory() {
+    std::error_code error;
+    std::filesystem::remove_all(path, error);
+  }
+
+  std::string path;
+};
+
+TEST_CASE("Snapshot rows are staged as CSV and bulk loaded") {
+  MockMemgraphClient mock_client;
+  const TempDirectory staging;
+  CsvBulkLoaderOptions csv_options;
+  csv_options.directory = staging.path;
+  csv_options.load_directory = "/import";
+  csv_options.rotate_rows = 0;
+  CsvBulkLoader loader(csv_options);
+
+  MessageHandlerOptions options;
+  options.bulk_loader = &loader;
+  MessageHandler handler(options);
+  auto snapshot = [](const std::string &table, const json &after) {
+    return json({{"payload",
+                  {{"op", "r"},
+                   {"after", after},
+                   {"source", {{"table", table}, {"snapshot", "true"}}}}}})
+        .dump();
+  };
+
+  SUBCASE("Nodes load before relationships, one query per file") {
+    handler.ProcessEvent(snapshot("user_skills", {{"user_id", 1},
+                                                  {"skill_id", 2}}),
+                         mock_client);
+    handler.ProcessEvent(
+        snapshot("users", {{"id", 1}, {"first_name", "Ann \"A\""}}),
+        mock_client);
+    handler.ProcessEvent(snapshot("users", {{"id", 2}}), mock_client);
+    CHECK(loader.Pending() == 3);
+    // Only the emptiness checks have run so far.
+    CHECK_FALSE(any_query_contains(mock_client, "LOAD CSV"));
+
+    handler.Flush(mock_client);
+    CHECK(loader.Pending() == 0);
+    std::vector<std::string> loads;
+    for (const auto &query : mock_client.queries)
+      if (query.rfind("LOAD CSV", 0) == 0)
+        loads.push_back(query);
+    REQUIRE(loads.size() == 2);
+    CHECK(loads[0] ==
+          "LOAD CSV FROM '/import/User.1.csv' WITH HEADER NULLIF '\\\\N' AS "
+          "row CREATE (n:User {id: toInteger(row.`id`)}) SET n.`first_name` "
+          "= row.`first_name`");
+    CHECK(loads[1] ==
+          "LOAD CSV FROM '/import/User_HAS_SKILL_Skill.0.csv' WITH HEADER "
+          "NULLIF '\\\\N' AS row MATCH (a:User {id: toInteger(row.`from_id`)}) "
+          "MATCH (b:Skill {id: toInteger(row.`to_id`)}) MERGE "
+          "(a)-[r:HAS_SKILL]->(b)");
+  }
+
+  SUBCASE("Any other event loads the staged rows first") {
+    handler.ProcessEvent(snapshot("users", {{"id", 1}}), mock_client);
+    handler.ProcessEvent(R"({"payload": {"op": "u",
+        "after": {"id": 1, "first_name": "B"},
+        "source": {"table": "users"}}})",
+                         mock_client);
+    REQUIRE(mock_client.queries.size() >= 2);
+    const size_t n = mock_client.queries.size();
+    CHECK(mock_client.queries[n - 2].rfind("LOAD CSV", 0) == 0);
+    CHECK(mock_client.queries[n - 1].rfind("MERGE (n:User", 0) == 0);
+  }
+
+  SUBCASE("Staged rows load before a snapshot MERGEs their label") {
+    handler.ProcessEvent(snapshot("users", {{"id", 1}}), mock_client);
+    handler.ProcessEvent(
+        snapshot("user_logins",
+                 {{"id", 5}, {"user_id", 1}, {"login_email", "a@b.c"}}),
+        mock_client);
+    CHECK(loader.Pending() == 0);
+    const size_t n = mock_client.queries.size();
+    REQUIRE(n >= 2);
+    CHECK(mock_client.queries[n - 2].rfind("LOAD CSV", 0) == 0);
+    CHECK(mock_client.queries[n - 1].rfind("MERGE (u:User", 0) == 0);
+  }
+
+  SUBCASE("Staged files are valid CSV and kept if loading fails") {
+    mg::Map props(2);
+    props.Insert("name", mg::Value("Ann \"A\""));
+    props.Insert("score", mg::Value(1.5));
+    mg::Map params(2);
+    params.Insert("id", mg::Value(7));
+    params.Insert("props", mg::Value(std::move(props)));
+    REQUIRE(loader.AddNode("Probe", params, mock_client));
+    mg::Map sparse(1);
+    sparse.Insert("id", mg::Value(8));
+    REQUIRE(loader.AddNode("Probe", sparse, mock_client));
+
+    mock_client.fail_on = "LOAD CSV";
+    CHECK_THROWS_AS(loader.Flush(mock_client), std::runtime_error);
+    std::ifstream in(staging.path + "/Probe.0.csv");
+    const std::string content((std::istreambuf_iterator<char>(in)),
+                              std::istreambuf_iterator<char>());
+    CHECK(content == "id,name,score\n7,\"Ann \"\"A\"\"\",1.5\n8,\\N,\\N\n");
+  }
+
+  SUBCASE("Rows of a failed load stay pending until it is retried") {
+    handler.ProcessRecord(snapshot("users", {{"id", 1}}), "users", 0, 5,
+                          mock_client);
+    mock_client.fail_on = "LOAD CSV";
+    CHECK_THROWS_AS(handler.Flush(mock_client), std::runtime_error);
+    CHECK(loader.Pending() == 1);
+    handler.ProcessRecord("", "users", 0, 6, mock_client);
+    CHECK(handler.TakeCommittedOffsets().empty());
+
+    handler.Flush(mock_client);
+    CHECK(loader.Pending() == 0);
+    // The mock records only the queries that succeed.
+    size_t loads = 0;
+    for (const auto &query : mock_client.queries)
+      loads += query.rfind("LOAD CSV FROM '/import/User.0.csv'", 0) == 0;
+    CHECK(loads == 1);
+    CHECK(handler.TakeCommittedOffsets().at({"users", 0}) == 6);
+  }
+
+  SUBCASE("Rows staged after a failed load go to a new file") {
+    handler.ProcessEvent(snapshot("users", {{"id", 1}}), mock_client);
+    mock_client.fail_on = "LOAD CSV";
+    mock_client.fail_times = 2;
+    CHECK_THROWS_AS(handler.Flush(mock_client), std::runtime_error);
+    CHECK_THROWS_AS(
+        handler.ProcessEvent(snapshot("users", {{"id", 2}}), mock_client),
+        std::runtime_error);
+    CHECK(loader.Pending() == 1);
+    handler.ProcessEvent(snapshot("users", {{"id", 2}}), mock_client);
+    CHECK(loader.Pending() == 1);
+    handler.Flush(mock_client);
+    CHECK(loader.Pending() == 0);
+  }
+}
+
+// --- Tests for ColumnPlan ---
+
+TEST_CASE("Columns are decoded to their Memgraph types") {
+  MockMemgraphClient mock_client;
+  MessageHandlerOptions options;
+  options.log_events = false;
+  MessageHandler handler(options);
+
+  const json row_schema = {
+      {"type", "struct"},
+      {"field", "after"},
+      {"fields",
+       json::array(
+           {{{"type", "int64"}, {"optional", false}, {"field", "id"}},
+            {{"type", "bytes"},
+             {"optional", true},
+             {"name", "org.apache.kafka.connect.data.Decimal"},
+             {"parameters",
+              {{"scale", "2"}, {"connect.decimal.precision", "10"}}},
+             {"field", "price"}},
+            {{"type", "bytes"},
+             {"optional", true},
+             {"name", "org.apache.kafka.connect.data.Decimal"},
+             {"parameters",
+              {{"scale", "2"}, {"connect.decimal.precision", "30"}}},
+             {"field", "total"}},
+            {{"type", "int32"},
+             {"optional", true},
+             {"name", "io.debezium.time.Date"},
+             {"field", "date_from"}},
+            {{"type", "int64"},
+             {"optional", true},
+             {"name", "io.debezium.time.MicroTimestamp"},
+             {"field", "created_at"}},
+            {{"type", "string"}, {"optional", true}, {"field", "note"}},
+            {{"type", "array"}, {"optional", true}, {"field", "tags"}}})}};
+  json event = {
+      {"schema",
+       {{"type", "struct"},
+        {"fields", json::array({row_schema})},
+        {"name", "tia_server.dev_tia_db.regions.Envelope"}}},
+      {"payload",
+       {{"op", "c"},
+        {"after",
+         {{"id", 9007199254740993LL},
+          {"price", "BNI="},
+          {"total", "AKtUqYzrHwrS"},
+          {"date_from", 19723},
+          {"created_at", 1704112205123456LL},
+          {"note", nullptr},
+          {"tags", {"a", 1}}}},
+        {"source", {{"table", "regions"}}}}}};
+
+  SUBCASE("Every column keeps its type, 64-bit ids included") {
+    REQUIRE(handler.ProcessParsedEvent(event, mock_client));
+    const mg::Value *id = mock_client.param("id");
+    REQUIRE(id);
+    REQUIRE(id->type() == mg::Value::Type::Int);
+    CHECK(id->ValueInt() == 9007199254740993LL);
+
+    const mg::Value *price = mock_client.param("price");
+    REQUIRE(price);
+    REQUIRE(price->type() == mg::Value::Type::Double);
+    CHECK(price->ValueDouble() == doctest::Approx(12.34));
+    const mg::Value *total = mock_client.param("total");
+    REQUIRE(total);
+    REQUIRE(total->type() == mg::Value::Type::String);
+    CHECK(total->ValueString() == "123456789012345678.90");
+
+    const mg::Value *date = mock_client.param("date_from");
+    REQUIRE(date);
+    REQUIRE(date->type() == mg::Value::Type::Date);
+    CHECK(format_date(date->ValueDate().days()) == "2024-01-01");
+    const mg::Value *created = mock_client.param("created_at");
+    REQUIRE(created);
+    REQUIRE(created->type() == mg::Value::Type::LocalDateTime);
+    CHECK(format_local_date_time(created->ValueLocalDateTime().seconds(),
+                                 created->ValueLocalDateTime().nanoseconds()) ==
+          "2024-01-01T12:30:05.123456");
+
+    const mg::Value *note = mock_client.param("note");
+    REQUIRE(note);
+    CHECK(note->type() == mg::Value::Type::Null);
+    const mg::Value *tags = mock_client.param("tags");
+    REQUIRE(tags);
+    REQUIRE(tags->type() == mg::Value::Type::List);
+    CHECK(tags->ValueList().size() == 2);
+  }
+
+  SUBCASE("Without a schema columns are decoded by their JSON type") {
+    event.erase("schema");
+    REQUIRE(handler.ProcessParsedEvent(event, mock_client));
+    CHECK(mock_client.param("id")->ValueInt() == 9007199254740993LL);
+    CHECK(mock_client.param("price")->type() == mg::Value::Type::String);
+    CHECK(mock_client.param("date_from")->type() == mg::Value::Type::Int);
+  }
+
+  SUBCASE("A changed schema gets a new plan") {
+    ColumnPlanCache cache;
+    const json envelope = event["schema"];
+    const ColumnPlan *plan = cache.Get("regions", envelope);
+    REQUIRE(plan);
+    CHECK(plan->Columns().size() == 7);
+    CHECK(cache.Get("regions", envelope) == plan);
+    CHECK(plan->Decode("date_from", 1).type() == mg::Value::Type::Date);
+    // Columns are decoded by index, or by name if the index does not match.
+    const std::vector<ColumnSpec> &columns = plan->Columns();
+    auto is_date_from = [](const ColumnSpec &c) {
+      return c.name == "date_from";
+    };
+    const size_t date_from = static_cast<size_t>(
+        std::find_if(columns.begin(), columns.end(), is_date_from) -
+        columns.begin());
+    REQUIRE(date_from < columns.size());
+    CHECK(plan->Decode(date_from, "date_from", 1).type() ==
+          mg::Value::Type::Date);
+    CHECK(plan->Decode(date_from + 1, "date_from", 1).type() ==
+          mg::Value::Type::Date);
+    CHECK(plan->Decode(columns.size(), "unknown", 1).type() ==
+          mg::Value::Type::Int);
+
+    json altered = envelope;
+    altered["fields"][0]["fields"][3].erase("name");
+    plan = cache.Get("regions", altered);
+    REQUIRE(plan);
+    CHECK(plan->Decode("date_from", 1).type() == mg::Value::Type::Int);
+  }
+
+  SUBCASE("Numeric strings keep their exact text") {
+    REQUIRE(handler.ProcessEvent(R"({"payload": {"op": "c",
+        "after": {"id": 1, "user_id": 4294967297, "login_email": 12},
+        "source": {"table": "user_logins"}}})",
+                                 mock_client));
+    CHECK(mock_client.param("user_id")->ValueInt() == 4294967297LL);
+    CHECK(mock_client.param("login_email")->ValueString() == "12");
+  }
+
+  SUBCASE("Temporal values are formatted as Cypher accepts them") {
+    CHECK(format_date(0) == "1970-01-01");
+    CHECK(format_date(-1) == "1969-12-31");
+    CHECK(format_local_time(3723000000000LL) == "01:02:03");
+    CHECK(format_local_date_time(-1, 500000000) ==
+          "1969-12-31T23:59:59.500000");
+    mg::Map params(1);
+    params.Insert("d", mg::Value(mg::Date(19723)));
+    CHECK(CypherScriptWriter::InlineParams("RETURN $d", params) ==
+          "RETURN date('2024-01-01')");
+  }
+}
+
+// --- Tests for PriorityScheduler ---
+
+TEST_CASE("Priority lanes share the apply loop by weight") {
+  PriorityScheduler scheduler(PriorityScheduler::LanesFromJson(R"([
+    {"name": "interactive", "tables": ["users"], "weight": 4,
+     "batch_size": 2, "max_latency_ms": 100, "max_queued": 4},
+    {"name": "default"},
+    {"name": "bulk", "tables": ["notifications"], "batch_size": 2,
+     "max_queued": 0}
+  ])"));
+  auto record = [](const std::string &table, int64_t offset, int64_t at) {
+    QueuedRecord r;
+    r.topic = "tia_server.dev_tia_db." + table;
+    r.offset = offset;
+    r.enqueued_ms = at;
+    return r;
+  };
+
+  SUBCASE("Topics go to the lane of their table") {
+    CHECK(scheduler.LaneFor("tia_server.dev_tia_db.users") == 0);
+    CHECK(scheduler.LaneFor("tia_server.dev_tia_db.skills") == 1);
+    CHECK(scheduler.LaneFor("__debezium-heartbeat.tia_server") == 1);
+    CHECK(scheduler.LaneFor("tia_server.dev_tia_db.notifications") == 2);
+    CHECK(scheduler.Config(0).max_latency_ms == 100);
+    CHECK(scheduler.Config(1).batch_size == 100);
+  }
+
+  SUBCASE("Backlogged lanes are served in proportion to their weight") {
+    for (int64_t i = 0; i < 100; ++i) {
+      scheduler.Enqueue(record("users", i, 0));
+      scheduler.Enqueue(record("notifications", i, 0));
+    }
+    size_t users = 0, notifications = 0;
+    int64_t last_user_offset = -1;
+    for (int turn = 0; turn < 20; ++turn) {
+      for (const QueuedRecord &r : scheduler.NextBatch(0)) {
+        if (r.topic.find("users") != std::string::npos) {
+          // Order within a topic is preserved.
+          CHECK(r.offset == last_user_offset + 1);
+          last_user_offset = r.offset;
+          ++users;
+        } else {
+          ++notifications;
+        }
+      }
+    }
+    CHECK(users == 4 * notifications);
+  }
+
+  SUBCASE("A lane past its latency target is served first") {
+    scheduler.Enqueue(record("users", 0, 0));
+    scheduler.NextBatch(0);
+    // 'users' has used its share, so the fair order would pick the bulk lane.
+    scheduler.Enqueue(record("notifications", 0, 0));
+    scheduler.Enqueue(record("users", 1, 0));
+    auto batch = scheduler.NextBatch(50);
+    REQUIRE(batch.size() == 1);
+    CHECK(batch[0].topic == "tia_server.dev_tia_db.notifications");
+    scheduler.Enqueue(record("notifications", 1, 0));
+    batch = scheduler.NextBatch(500);
+    REQUIRE(batch.size() == 1);
+    CHECK(batch[0].offset == 1);
+    CHECK(batch[0].topic == "tia_server.dev_tia_db.users");
+  }
+
+  SUBCASE("Full lanes are paused until they have drained") {
+    scheduler.LaneFor("tia_server.dev_tia_db.users");
+    for (int64_t i = 0; i < 4; ++i)
+      scheduler.Enqueue(record("users", i, 0));
+    auto changes = scheduler.UpdateFlowControl();
+    REQUIRE(changes.size() == 1);
+    CHECK(changes[0].pause);
+    CHECK(changes[0].topics ==
+          std::vector<std::string>{"tia_server.dev_tia_db.users"});
+    CHECK(scheduler.UpdateFlowControl().empty());
+
+    scheduler.NextBatch(0);
+    changes = scheduler.UpdateFlowControl();
+    REQUIRE(changes.size() == 1);
+    CHECK_FALSE(changes[0].pause);
+    CHECK(scheduler.Queued() == 2);
+  }
+
+  SUBCASE("Records of revoked partitions are dropped") {
+    for (int64_t i = 0; i < 3; ++i) {
+      scheduler.Enqueue(record("users", i, 0));
+      QueuedRecord other = record("users", i, 0);
+      other.partition = 1;
+      scheduler.Enqueue(other);
+      scheduler.Enqueue(record("notifications", i, 0));
+    }
+    CHECK(scheduler.DropPartitions({{"tia_server.dev_tia_db.users", 0},
+                                    {"tia_server.dev_tia_db.skills", 0}}) ==
+          3);
+    CHECK(scheduler.Queued() == 6);
+    CHECK(scheduler.Queued(0) == 3);
+    std::vector<QueuedRecord> batch = scheduler.NextBatch(0);
+    while (!batch.empty()) {
+      for (const QueuedRecord &r : batch)
+        CHECK_FALSE((r.topic == "tia_server.dev_tia_db.users" &&
+                     r.partition == 0));
+      batch = scheduler.NextBatch(0);
+    }
+  }
+
+  SUBCASE("Invalid configurations are rejected") {
+    CHECK_THROWS_AS(PriorityScheduler::LanesFromJson("{}"),
+                    std::runtime_error);
+    CHECK_THROWS_AS(PriorityScheduler::LanesFromJson(R"([{"weight": 1}])"),
+                    std::runtime_error);
+    CHECK_THROWS_AS(PriorityScheduler(PriorityScheduler::LanesFromJson(
+                        R"([{"name": "a", "weight": 0}])")),
+                    std::runtime_error);
+  }
+}
+
+// --- Tests for Tracer ---
+
+#ifndef SYNC_DISABLE_TRACING
+TEST_CASE("Sampled events are traced stage by stage") {
+  MockMemgraphClient mock_client;
+  MessageHandlerOptions options;
+  options.log_events = false;
+  MessageHandler handler(options);
+  const std::string event = R"({"payload": {"op": "c",
+      "after": {"id": 1, "first_name": "A"},
+      "source": {"table": "users"}}})";
+  auto spans = [](const json &trace, const std::string &name) {
+    size_t count = 0;
+    for (const auto &e : trace["traceEvents"])
+      if (e["ph"] == "X" && e["name"] == name)
+        ++count;
+    return count;
+  };
+
+  SUBCASE("Every stage of a sampled event is recorded") {
+    Tracer::Instance().Configure(1, 64);
+    handler.ProcessRecord(event, "tia_server.dev_tia_db.users", 0, 1,
+                          mock_client);
+    const json trace = json::parse(Tracer::Instance().ToChromeJson());
+    CHECK(spans(trace, "process") == 1);
+    CHECK(spans(trace, "parse") == 1);
+    CHECK(spans(trace, "route") == 1);
+    CHECK(spans(trace, "params") == 1);
+    bool has_topic = false;
+    for (const auto &e : trace["traceEvents"])
+      if (e["name"] == "process")
+        has_topic = e["args"]["detail"] == "tia_server.dev_tia_db.users";
+    CHECK(has_topic);
+    CHECK_FALSE(Tracer::Sampled());
+  }
+
+  SUBCASE("Only every Nth event is sampled") {
+    Tracer::Instance().Configure(0.25, 64);
+    for (int i = 0; i < 8; ++i)
+      handler.ProcessRecord(event, "users", 0, i, mock_client);
+    CHECK(spans(json::parse(Tracer::Instance().ToChromeJson()), "process") ==
+          2);
+  }
+
+  SUBCASE("The ring buffer keeps the newest spans") {
+    Tracer::Instance().Configure(1, 4);
+    for (int i = 0; i < 3; ++i)
+      handler.ProcessRecord(event, "users", 0, i, mock_client);
+    const json trace = json::parse(Tracer::Instance().ToChromeJson());
+    CHECK(spans(trace, "process") == 1);
+    CHECK(spans(trace, "params") + spans(trace, "route") +
+              spans(trace, "parse") + spans(trace, "process") ==
+          4);
+  }
+
+  SUBCASE("Every span keeps its own detail") {
+    Tracer::Instance().Configure(1, 64);
+    const std::vector<std::string> details = {"MATCH (a)", "MATCH (b)",
+                                              "MATCH (a)", "MERGE (c)"};
+    for (const std::string &detail : details)
+      Tracer::Instance().Record("query", detail, 0, 1);
+    const json trace = json::parse(Tracer::Instance().ToChromeJson());
+    std::vector<std::string> recorded;
+    for (const auto &e : trace["traceEvents"])
+      if (e["name"] == "query")
+        recorded.push_back(e["args"]["detail"]);
+    CHECK(recorded == details);
+  }
+
+  Tracer::Instance().Configure(0, 64);
+}
+#endif